@@ -2,6 +2,8 @@
 #define PI 3.14159265
 
 uniform sampler2D heightmap;
+uniform sampler2D normalmap;
+uniform sampler2D splatmap; // grass, gravel, snow and stone weights
 uniform sampler2D grass;
 uniform sampler2D stone;
 uniform sampler2D snow;
@@ -22,21 +24,12 @@ vec3 fog(vec3 c, float dist, float height)
 	return c * extinction + fog_color * (1.0 - inscattering);
 }
 
-vec3 filter_normal(vec2 texcoords, float ratio, float ampl, sampler2D heightm)
+// x and z of the normal baked by the normals stage, y is never negative
+vec3 baked_normal(vec2 texcoords, float ratio)
 {
-	const ivec3 offset = ivec3(-1, 0, 1);
-	float detail = 64.0;
-	float delta = detail * ampl / textureSize(heightm, 0 ).x;
-	float left = ampl * textureOffset(heightm, texcoords * ratio, offset.xy).r;
-	float right = ampl * textureOffset(heightm, texcoords * ratio, offset.zy).r;
-	float top = ampl * textureOffset(heightm, texcoords * ratio, offset.yz).r;
-	float bottom = ampl * textureOffset(heightm, texcoords * ratio, offset.yx).r;
+	vec2 n = texture(normalmap, texcoords * ratio).rg;
 
-	vec3 x = vec3( delta, right - left, 0.0 );
-	vec3 z = vec3( 0.0, top - bottom, delta );
-	vec3 n = cross(z, x);
-
-	return n;
+	return vec3(n.x, sqrt(max(1.0 - dot(n, n), 0.0)), n.y);
 }
 
 // this can have a performance impact
@@ -60,20 +53,23 @@ void main(void)
 {
 	const vec3 light_dir = vec3(-1.0, 1.0, -1.0);
 	const float texsize = 1.0 / 64.0;
-	vec3 wnorm = filter_normal(uv, texsize, 1.0, heightmap);
+	vec3 wnorm = baked_normal(uv, texsize);
 
-	vec4 grassf = texture(grass, uv);
-	vec3 stonef = tri_planar_texture(wnorm, stone, fpos);
-	vec4 snowf = texture(snow, 0.5 * uv);
-	vec4 gravelf = texture(gravel, uv);
+	// baked by the splat stage, only the materials present are sampled
+	vec4 weight = texture(splatmap, uv * texsize);
+	weight /= max(dot(weight, vec4(1.0)), 0.0001);
+	vec3 material = vec3(0.0);
+	if (weight.r > 0.0)
+		material += weight.r * texture(grass, uv).xyz;
+	if (weight.g > 0.0)
+		material += weight.g * texture(gravel, uv).xyz;
+	if (weight.b > 0.0)
+		material += weight.b * texture(snow, 0.5 * uv).xyz;
+	if (weight.a > 0.0)
+		material += weight.a * tri_planar_texture(wnorm, stone, fpos);
 
 	vec3 n = normalize(wnorm);
-	float slope = 1.0 - n.y;
 	float diff = max(dot(n, normalize(light_dir)), 0.0);
-	vec3 material = grassf.xyz;
-	material = mix(material, snowf.xyz, smoothstep(0.4, 0.6 , height));
-	material = mix(gravelf.xyz, material, smoothstep(0.12, 0.15 , height));
-	material = mix(material, stonef.xyz, smoothstep(0.1, 0.7, slope));
 	material *= clamp(diff, 0.5, 1.0);
 
 	vec3 view_space = vec3(distance(fpos.x, view_eye.x), distance(fpos.y, view_eye.y), distance(fpos.z, view_eye.z));
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+struct arena {
+	char *base; /* aligned to a huge page */
+	size_t size;
+	size_t used;
+	size_t peak;
+	void *mapping; /* the reservation, base rounded up inside it */
+	size_t mapsize;
+};
+
+static size_t align_up(size_t n, size_t align)
+{
+	return (n + align - 1) & ~(align - 1);
+}
+
+struct arena *arena_create(size_t size)
+{
+	/* one huge page of slack to align the base */
+	size = align_up(size, ARENA_HUGE_PAGE);
+	const size_t mapsize = size + ARENA_HUGE_PAGE;
+	void *map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "error: could not reserve an arena of %zu bytes: ", mapsize);
+		perror(NULL);
+		abort();
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(map, mapsize, MADV_HUGEPAGE);
+#endif
+
+	struct arena *arena = calloc(1, sizeof(struct arena));
+	arena->mapping = map;
+	arena->mapsize = mapsize;
+	arena->base = (char *)align_up((uintptr_t)map, ARENA_HUGE_PAGE);
+	arena->size = size;
+
+	return arena;
+}
+
+void arena_destroy(struct arena *arena)
+{
+	if (arena) {
+		munmap(arena->mapping, arena->mapsize);
+		free(arena);
+	}
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	const size_t align = size >= ARENA_HUGE_PAGE ? ARENA_HUGE_PAGE : ARENA_ALIGN;
+	const size_t start = align_up(arena->used, align);
+	if (start + size > arena->size) {
+		fprintf(stderr, "error: arena of %zu bytes exhausted by %zu more\n", arena->size, size);
+		abort();
+	}
+
+	arena->used = start + size;
+	if (arena->used > arena->peak) {
+		arena->peak = arena->used;
+	}
+
+	return arena->base + start;
+}
+
+size_t arena_mark(const struct arena *arena)
+{
+	return arena->used;
+}
+
+void arena_release(struct arena *arena, size_t mark)
+{
+	arena->used = mark;
+}
+
+void arena_reset(struct arena *arena)
+{
+	arena->used = 0;
+}
+
+size_t arena_size(const struct arena *arena)
+{
+	return arena->size;
+}
+
+size_t arena_peak(const struct arena *arena)
+{
+	return arena->peak;
+}
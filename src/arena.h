@@ -0,0 +1,31 @@
+/* bump allocator over one reservation of address space
+ * pages are committed on first touch and stay committed across resets, so a
+ * regeneration reuses the memory of the last one without page faults, large
+ * blocks are aligned to huge pages and the reservation asks for them */
+
+#define ARENA_ALIGN 64 /* every block starts on a cache line */
+#define ARENA_HUGE_PAGE ((size_t)2 << 20) /* blocks at least this big start on a huge page */
+
+struct arena;
+
+/* reserves size bytes of address space, nothing is committed yet, a failed
+ * reservation is an error and abort() like an exhausted one */
+struct arena *arena_create(size_t size);
+
+void arena_destroy(struct arena *arena);
+
+/* uninitialized, runs out of the reservation with an error and abort() */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/* arena_release() frees everything allocated after the mark */
+size_t arena_mark(const struct arena *arena);
+
+void arena_release(struct arena *arena, size_t mark);
+
+/* releases every block but keeps the pages */
+void arena_reset(struct arena *arena);
+
+size_t arena_size(const struct arena *arena);
+
+/* high water mark of the bytes in use since the arena was created */
+size_t arena_peak(const struct arena *arena);
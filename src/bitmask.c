@@ -0,0 +1,411 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "gmath.h"
+#include "bitmask.h"
+
+typedef unsigned long long word;
+
+/* a run of set pixels [x0, x1) of one row, parent and size are union-find
+ * state of the components */
+struct run {
+	int x0;
+	int x1;
+	int parent;
+	long size;
+};
+
+static long count_generic(const word *w, size_t n);
+static void detect_isa(void);
+
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+static long (*count_words)(const word *w, size_t n) = count_generic;
+
+static inline int row_words(int width)
+{
+	return (width + BITMASK_ROW_BITS - 1) / BITMASK_ROW_BITS * (BITMASK_ROW_BITS / 64);
+}
+
+static inline word *row(const struct bitmask *mask, int y)
+{
+	return mask->bits + (size_t)y * mask->stride;
+}
+
+/* the data bits of the last word of a row */
+static inline word tail_bits(int width)
+{
+	return width % 64 ? (1ULL << (width % 64)) - 1 : ~0ULL;
+}
+
+struct bitmask bitmask_make(int width, int height)
+{
+	const size_t size = bitmask_bytes(width, height);
+	void *storage = aligned_alloc(BITMASK_ALIGN, max(size, BITMASK_ALIGN));
+	struct bitmask mask = bitmask_wrap(storage, width, height);
+	mask.storage = storage;
+	bitmask_clear(&mask);
+
+	return mask;
+}
+
+size_t bitmask_bytes(int width, int height)
+{
+	return (size_t)row_words(width) * height * sizeof(word);
+}
+
+struct bitmask bitmask_wrap(void *bits, int width, int height)
+{
+	struct bitmask mask = {width, height, row_words(width), bits, NULL};
+
+	return mask;
+}
+
+void bitmask_free(struct bitmask *mask)
+{
+	free(mask->storage);
+	mask->storage = NULL;
+	mask->bits = NULL;
+}
+
+void bitmask_clear(struct bitmask *mask)
+{
+	memset(mask->bits, 0, bitmask_bytes(mask->width, mask->height));
+}
+
+/* zeroes the padding after an operation that may have spilled into it */
+static void clear_padding(struct bitmask *mask, int y)
+{
+	word *r = row(mask, y);
+	const int last = (mask->width - 1) / 64;
+	r[last] &= tail_bits(mask->width);
+	for (int j = last + 1; j < mask->stride; j++) {
+		r[j] = 0;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+
+/* 64 compares of 16 bytes at a time, sse2 is part of the x86-64 baseline */
+static word pack_word(const unsigned char *p, unsigned char value)
+{
+	const __m128i v = _mm_set1_epi8(value);
+	word w = 0;
+	for (int i = 0; i < 4; i++) {
+		const __m128i b = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+		w |= (word)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(b, v)) << (16 * i);
+	}
+
+	return w;
+}
+#else
+static word pack_word(const unsigned char *p, unsigned char value)
+{
+	word w = 0;
+	for (int i = 0; i < 64; i++) {
+		w |= (word)(p[i] == value) << i;
+	}
+
+	return w;
+}
+#endif
+
+void bitmask_pack(struct bitmask *mask, const unsigned char *bytes, unsigned char value)
+{
+	const int width = mask->width;
+	for (int y = 0; y < mask->height; y++) {
+		const unsigned char *src = &bytes[(size_t)y * width];
+		word *r = row(mask, y);
+		int x = 0;
+		for (; x + 64 <= width; x += 64) {
+			r[x/64] = pack_word(src + x, value);
+		}
+		if (x < width) {
+			word w = 0;
+			for (int i = 0; x + i < width; i++) {
+				w |= (word)(src[x+i] == value) << i;
+			}
+			r[x/64] = w;
+			x += 64;
+		}
+		for (int j = x / 64; j < mask->stride; j++) {
+			r[j] = 0;
+		}
+	}
+}
+
+void bitmask_unpack(unsigned char *bytes, const struct bitmask *mask, unsigned char on, unsigned char off)
+{
+	const int width = mask->width;
+	const unsigned char diff = on ^ off;
+	for (int y = 0; y < mask->height; y++) {
+		unsigned char *dst = &bytes[(size_t)y * width];
+		const word *r = row(mask, y);
+		for (int x = 0; x < width; x++) {
+			const unsigned char bit = r[x/64] >> (x % 64) & 1;
+			dst[x] = off ^ (diff & -bit);
+		}
+	}
+}
+
+void bitmask_and(struct bitmask *dst, const struct bitmask *a, const struct bitmask *b)
+{
+	const size_t n = (size_t)dst->stride * dst->height;
+	for (size_t i = 0; i < n; i++) {
+		dst->bits[i] = a->bits[i] & b->bits[i];
+	}
+}
+
+void bitmask_or(struct bitmask *dst, const struct bitmask *a, const struct bitmask *b)
+{
+	const size_t n = (size_t)dst->stride * dst->height;
+	for (size_t i = 0; i < n; i++) {
+		dst->bits[i] = a->bits[i] | b->bits[i];
+	}
+}
+
+void bitmask_andnot(struct bitmask *dst, const struct bitmask *a, const struct bitmask *b)
+{
+	const size_t n = (size_t)dst->stride * dst->height;
+	for (size_t i = 0; i < n; i++) {
+		dst->bits[i] = a->bits[i] & ~b->bits[i];
+	}
+}
+
+enum neighbor_op {
+	ERODE,
+	DILATE,
+	BOUNDARY,
+};
+
+/* the left and right neighbors of a word are the word shifted by one with
+ * the bit carried over from the neighboring word */
+static void neighbors(struct bitmask *dst, const struct bitmask *src, enum neighbor_op op)
+{
+	const int n = src->stride;
+	for (int y = 0; y < src->height; y++) {
+		const word *r = row(src, y);
+		const word *up = y > 0 ? r - n : NULL;
+		const word *down = y < src->height - 1 ? r + n : NULL;
+		word *out = row(dst, y);
+		for (int j = 0; j < n; j++) {
+			const word c = r[j];
+			const word l = c << 1 | (j > 0 ? r[j-1] >> 63 : 0);
+			const word rt = c >> 1 | (j < n - 1 ? r[j+1] << 63 : 0);
+			const word u = up ? up[j] : 0;
+			const word d = down ? down[j] : 0;
+			switch (op) {
+			case ERODE: out[j] = c & l & rt & u & d; break;
+			case DILATE: out[j] = c | l | rt | u | d; break;
+			case BOUNDARY: out[j] = c & ~(l & rt & u & d); break;
+			}
+		}
+		if (op == DILATE) {
+			clear_padding(dst, y);
+		}
+	}
+}
+
+void bitmask_erode(struct bitmask *dst, const struct bitmask *src)
+{
+	neighbors(dst, src, ERODE);
+}
+
+void bitmask_dilate(struct bitmask *dst, const struct bitmask *src)
+{
+	neighbors(dst, src, DILATE);
+}
+
+void bitmask_boundary(struct bitmask *dst, const struct bitmask *src)
+{
+	neighbors(dst, src, BOUNDARY);
+}
+
+static long count_generic(const word *w, size_t n)
+{
+	long count = 0;
+	for (size_t i = 0; i < n; i++) {
+		count += __builtin_popcountll(w[i]);
+	}
+
+	return count;
+}
+
+long bitmask_count(const struct bitmask *mask)
+{
+	pthread_once(&isa_once, detect_isa);
+	return count_words(mask->bits, (size_t)mask->stride * mask->height);
+}
+
+int bitmask_count_span(const struct bitmask *mask, int y, int x0, int x1)
+{
+	if (x0 >= x1) {
+		return 0;
+	}
+
+	const word *r = row(mask, y);
+	const int j0 = x0 / 64;
+	const int j1 = (x1 - 1) / 64;
+	const word first = ~0ULL << (x0 % 64);
+	const word last = ~0ULL >> (63 - (x1 - 1) % 64);
+	if (j0 == j1) {
+		return __builtin_popcountll(r[j0] & first & last);
+	}
+
+	int count = __builtin_popcountll(r[j0] & first) + __builtin_popcountll(r[j1] & last);
+	for (int j = j0 + 1; j < j1; j++) {
+		count += __builtin_popcountll(r[j]);
+	}
+
+	return count;
+}
+
+/* first pixel at or after x whose bit equals set, width when there is none */
+static int next_bit(const word *r, int width, int x, int set)
+{
+	const int n = (width + 63) / 64;
+	int j = x / 64;
+	if (j >= n) {
+		return width;
+	}
+
+	word w = (set ? r[j] : ~r[j]) & ~0ULL << (x % 64);
+	while (!w) {
+		if (++j >= n) {
+			return width;
+		}
+		w = set ? r[j] : ~r[j];
+	}
+
+	return min(j * 64 + __builtin_ctzll(w), width);
+}
+
+static int find_root(struct run *run, int i)
+{
+	while (run[i].parent != i) {
+		run[i].parent = run[run[i].parent].parent;
+		i = run[i].parent;
+	}
+
+	return i;
+}
+
+/* the smaller root becomes the new root */
+static void merge(struct run *run, int a, int b)
+{
+	a = find_root(run, a);
+	b = find_root(run, b);
+	if (a < b) {
+		run[b].parent = a;
+	} else {
+		run[a].parent = b;
+	}
+}
+
+int bitmask_clear_components(struct bitmask *mask, long minsize, long maxsize)
+{
+	const int width = mask->width;
+	const int height = mask->height;
+
+	/* a run starts at every set bit whose left neighbor is unset */
+	long nrun = 0;
+	for (int y = 0; y < height; y++) {
+		const word *r = row(mask, y);
+		word carry = 0;
+		for (int j = 0; j < mask->stride; j++) {
+			nrun += __builtin_popcountll(r[j] & ~(r[j] << 1 | carry));
+			carry = r[j] >> 63;
+		}
+	}
+
+	struct run *run = malloc(max(nrun, 1) * sizeof(struct run));
+	int *first = malloc((height + 1) * sizeof(int)); /* first run of every row */
+	int k = 0;
+	for (int y = 0; y < height; y++) {
+		const word *r = row(mask, y);
+		first[y] = k;
+		int x = next_bit(r, width, 0, 1);
+		while (x < width) {
+			const int end = next_bit(r, width, x, 0);
+			run[k] = (struct run){x, end, k, end - x};
+			k++;
+			x = next_bit(r, width, end, 1);
+		}
+
+		/* runs of neighboring rows that overlap are 4-connected */
+		if (y > 0) {
+			int a = first[y-1];
+			int b = first[y];
+			while (a < first[y] && b < k) {
+				if (run[a].x0 < run[b].x1 && run[b].x0 < run[a].x1) {
+					merge(run, a, b);
+				}
+				if (run[a].x1 < run[b].x1) {
+					a++;
+				} else {
+					b++;
+				}
+			}
+		}
+	}
+	first[height] = k;
+
+	/* roots come before the rest of their component, so one forward sweep
+	 * flattens the trees and sums the sizes */
+	int ncomponents = 0;
+	for (int i = 0; i < k; i++) {
+		if (run[i].parent == i) {
+			ncomponents++;
+		} else {
+			run[i].parent = run[run[i].parent].parent;
+			run[run[i].parent].size += run[i].size;
+		}
+	}
+
+	for (int y = 0; y < height; y++) {
+		word *r = row(mask, y);
+		for (int i = first[y]; i < first[y+1]; i++) {
+			const long size = run[run[i].parent].size;
+			if (size < minsize || size >= maxsize) {
+				continue;
+			}
+			for (int x = run[i].x0; x < run[i].x1; ) {
+				const int j = x / 64;
+				const int end = min(run[i].x1, (j + 1) * 64);
+				const word bits = (end - x == 64 ? ~0ULL : ((1ULL << (end - x)) - 1)) << (x % 64);
+				r[j] &= ~bits;
+				x = end;
+			}
+		}
+	}
+
+	free(first);
+	free(run);
+
+	return ncomponents;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("popcnt")))
+static long count_popcnt(const word *w, size_t n)
+{
+	long count = 0;
+	for (size_t i = 0; i < n; i++) {
+		count += __builtin_popcountll(w[i]);
+	}
+
+	return count;
+}
+
+static void detect_isa(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("popcnt")) {
+		count_words = count_popcnt;
+	}
+}
+#else
+static void detect_isa(void)
+{
+}
+#endif
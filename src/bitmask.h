@@ -0,0 +1,58 @@
+/* one bit per pixel masks
+ * bit x % 64 of word x / 64 of a row is pixel x, rows are padded to
+ * BITMASK_ROW_BITS with zeros, so every operation runs a word of 64 pixels
+ * at a time and pixels outside the mask read as unset */
+
+#define BITMASK_ROW_BITS 256
+#define BITMASK_ALIGN 64
+
+struct bitmask {
+	int width; /* in pixels */
+	int height;
+	int stride; /* words from one row to the next */
+	unsigned long long *bits;
+	void *storage; /* what bitmask_free() releases, NULL for wrapped memory */
+};
+
+/* every bit unset */
+struct bitmask bitmask_make(int width, int height);
+
+/* bytes of memory a mask of this size wraps */
+size_t bitmask_bytes(int width, int height);
+
+/* a mask over caller memory aligned to 8 bytes, its contents are undefined
+ * until bitmask_pack() or bitmask_clear() */
+struct bitmask bitmask_wrap(void *bits, int width, int height);
+
+void bitmask_free(struct bitmask *mask);
+
+void bitmask_clear(struct bitmask *mask);
+
+/* sets the pixels of a width by height byte image that equal value */
+void bitmask_pack(struct bitmask *mask, const unsigned char *bytes, unsigned char value);
+
+/* on for the set pixels and off for the others */
+void bitmask_unpack(unsigned char *bytes, const struct bitmask *mask, unsigned char on, unsigned char off);
+
+/* the masks have the same size, dst may be a or b */
+void bitmask_and(struct bitmask *dst, const struct bitmask *a, const struct bitmask *b);
+void bitmask_or(struct bitmask *dst, const struct bitmask *a, const struct bitmask *b);
+void bitmask_andnot(struct bitmask *dst, const struct bitmask *a, const struct bitmask *b);
+
+/* one step of the 4-neighborhood, dst must not be src */
+void bitmask_erode(struct bitmask *dst, const struct bitmask *src);
+void bitmask_dilate(struct bitmask *dst, const struct bitmask *src);
+
+/* the set pixels with an unset 4-neighbor, dst must not be src */
+void bitmask_boundary(struct bitmask *dst, const struct bitmask *src);
+
+long bitmask_count(const struct bitmask *mask);
+
+/* set pixels of row y in [x0, x1) */
+int bitmask_count_span(const struct bitmask *mask, int y, int x0, int x1);
+
+/* unsets the 4-connected components of set pixels with at least minsize and
+ * fewer than maxsize pixels, the components are unions of the runs of every
+ * row so the cost follows the number of runs rather than the pixels,
+ * returns the number of components */
+int bitmask_clear_components(struct bitmask *mask, long minsize, long maxsize);
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "quadtree.h"
+#include "world.h"
+#include "cache.h"
+
+#define CACHE_MAGIC "TERRWRLD"
+#define CACHE_ALIGN 4096
+
+/* the planes follow the header, every plane starts on a page boundary */
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t resolution;
+	uint64_t key;
+	uint64_t offset[3 + LAYER_COUNT]; /* height, normal and splat planes, then the layers */
+};
+
+static size_t align_up(size_t n)
+{
+	return (n + CACHE_ALIGN - 1) & ~(size_t)(CACHE_ALIGN - 1);
+}
+
+/* lays out the planes, returns the file size */
+static size_t plan_layout(struct cache_header *header, int res)
+{
+	const size_t size = (size_t)res * res;
+	size_t offset = align_up(sizeof(struct cache_header));
+
+	header->offset[0] = offset;
+	offset = align_up(offset + size * sizeof(unsigned short));
+	header->offset[1] = offset;
+	offset = align_up(offset + 2 * size * sizeof(short));
+	header->offset[2] = offset;
+	offset = align_up(offset + SPLAT_COUNT * size);
+	for (int i = 0; i < LAYER_COUNT; i++) {
+		header->offset[3+i] = offset;
+		offset = align_up(offset + size);
+	}
+
+	return offset;
+}
+
+static void cache_path(char *buf, size_t len, const char *dir, uint64_t key)
+{
+	snprintf(buf, len, "%s/%016llx.world", dir, (unsigned long long)key);
+}
+
+/* mkdir -p */
+static int make_dirs(const char *dir)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s", dir);
+
+	for (char *p = path + 1; *p; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+				return 0;
+			}
+			*p = '/';
+		}
+	}
+
+	return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+const char *cache_default_dir(void)
+{
+	static char dir[4096];
+	const char *env = getenv("TERRAGEN_CACHE");
+	if (env && *env) {
+		snprintf(dir, sizeof(dir), "%s", env);
+		return dir;
+	}
+
+	env = getenv("XDG_CACHE_HOME");
+	if (env && *env) {
+		snprintf(dir, sizeof(dir), "%s/terragen", env);
+		return dir;
+	}
+
+	env = getenv("HOME");
+	snprintf(dir, sizeof(dir), "%s/.cache/terragen", (env && *env) ? env : ".");
+
+	return dir;
+}
+
+int cache_load(const char *dir, const struct world_params *params, struct world *world)
+{
+	const uint64_t key = world_params_hash(params);
+	char path[4096];
+	cache_path(path, sizeof(path), dir, key);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+
+	struct stat st;
+	struct cache_header header, expect = {0};
+	const size_t filesize = plan_layout(&expect, params->resolution);
+	if (fstat(fd, &st) != 0 || st.st_size != filesize
+		|| read(fd, &header, sizeof(header)) != sizeof(header)
+		|| memcmp(header.magic, CACHE_MAGIC, 8) != 0
+		|| header.version != WORLD_VERSION
+		|| header.resolution != params->resolution
+		|| header.key != key
+		|| memcmp(header.offset, expect.offset, sizeof(header.offset)) != 0) {
+		fprintf(stderr, "warning: %s: ignoring stale cache file\n", path);
+		close(fd);
+		return 0;
+	}
+
+	/* private so later stages can modify the planes without touching the file */
+	void *map = mmap(NULL, filesize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror(path);
+		return 0;
+	}
+
+	memset(world, 0, sizeof(struct world));
+	world->resolution = params->resolution;
+	world->params = *params;
+	world->mapping = map;
+	world->mapsize = filesize;
+	world->height = (unsigned short *)((char *)map + header.offset[0]);
+	world->normal = (short *)((char *)map + header.offset[1]);
+	world->splat = (unsigned char *)map + header.offset[2];
+	for (int i = 0; i < LAYER_COUNT; i++) {
+		world->layer[i] = (unsigned char *)map + header.offset[3+i];
+	}
+	/* the pyramid is cheap next to the heights, so it is not stored */
+	world->bounds = quadtree_build(world->height, world->resolution, world->resolution, NULL);
+
+	return 1;
+}
+
+int cache_store(const char *dir, const struct world *world)
+{
+	if (!make_dirs(dir)) {
+		perror(dir);
+		return 0;
+	}
+
+	struct cache_header header = {0};
+	memcpy(header.magic, CACHE_MAGIC, 8);
+	header.version = WORLD_VERSION;
+	header.resolution = world->resolution;
+	header.key = world_params_hash(&world->params);
+	const size_t filesize = plan_layout(&header, world->resolution);
+	const size_t size = (size_t)world->resolution * world->resolution;
+
+	/* write to a temporary name and rename, readers never see a partial file */
+	char path[4096], tmp[4096 + 16];
+	cache_path(path, sizeof(path), dir, header.key);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+	FILE *fp = fopen(tmp, "wb");
+	if (fp == NULL) {
+		perror(tmp);
+		return 0;
+	}
+
+	int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && fseek(fp, header.offset[0], SEEK_SET) == 0;
+	ok = ok && fwrite(world->height, sizeof(unsigned short), size, fp) == size;
+	ok = ok && fseek(fp, header.offset[1], SEEK_SET) == 0;
+	ok = ok && fwrite(world->normal, sizeof(short), 2 * size, fp) == 2 * size;
+	ok = ok && fseek(fp, header.offset[2], SEEK_SET) == 0;
+	ok = ok && fwrite(world->splat, 1, SPLAT_COUNT * size, fp) == SPLAT_COUNT * size;
+	for (int i = 0; i < LAYER_COUNT && ok; i++) {
+		ok = fseek(fp, header.offset[3+i], SEEK_SET) == 0;
+		ok = ok && fwrite(world->layer[i], 1, size, fp) == size;
+	}
+	/* pad the last plane to the full page, unless it already ends there */
+	if (ok && ftell(fp) < (long)filesize) {
+		ok = fseek(fp, filesize - 1, SEEK_SET) == 0 && fputc(0, fp) != EOF;
+	}
+
+	if (fclose(fp) != 0) {
+		ok = 0;
+	}
+	if (ok && rename(tmp, path) != 0) {
+		ok = 0;
+	}
+	if (!ok) {
+		fprintf(stderr, "error: %s: could not write cache file\n", path);
+		remove(tmp);
+	}
+
+	return ok;
+}
@@ -0,0 +1,13 @@
+/* on-disk cache of generated worlds
+ * a world is stored under the hash of its parameters, so a later run with the
+ * same seed and tunables maps the stored planes instead of generating them */
+
+/* directory of the cache: $TERRAGEN_CACHE, $XDG_CACHE_HOME/terragen or
+ * ~/.cache/terragen, the returned string is static */
+const char *cache_default_dir(void);
+
+/* maps a cached world, returns 0 on a miss, release it with world_free() */
+int cache_load(const char *dir, const struct world_params *params, struct world *world);
+
+/* writes the final heights, the normals, the splat map and the intermediate layers, returns 0 on failure */
+int cache_store(const char *dir, const struct world *world);
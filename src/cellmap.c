@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gmath.h"
+#include "pool.h"
+#include "voronoi.h"
+#include "cellmap.h"
+
+#define CELLMAP_TASK_CELLS 64
+
+struct raster_job {
+	struct cellmap *map;
+	const jcv_site *sites;
+};
+
+/* rows [*y0, *y1) that may hold pixels of the cell, one row of margin on
+ * either side since the jcv vertices are only approximate */
+static void cell_rows(const jcv_site *site, int height, int *y0, int *y1)
+{
+	float ymin = INFINITY;
+	float ymax = -INFINITY;
+	for (const jcv_graphedge *e = site->edges; e; e = e->next) {
+		ymin = min(ymin, min(e->pos[0].y, e->pos[1].y));
+		ymax = max(ymax, max(e->pos[0].y, e->pos[1].y));
+	}
+
+	if (site->edges == NULL) {
+		*y0 = *y1 = 0;
+		return;
+	}
+	*y0 = min(max((int)ceilf(ymin - 0.5f) - 1, 0), height);
+	*y1 = min(max((int)ceilf(ymax - 0.5f) + 1, *y0), height);
+}
+
+/* pixel centers of the row centered at yc that are closer to site k than
+ * to any of its neighbors, the cell is the intersection of the half planes
+ * bounded by the bisectors to its neighbors, each bisector is evaluated for
+ * the pair in index order so both cells sharing it get the same threshold
+ * and every pixel ends up in exactly one cell, unlike the edge endpoints jcv
+ * computes separately for every edge */
+static void cell_span(const jcv_site *sites, int k, float yc, int width, int *x0, int *x1)
+{
+	int lo = 0;
+	int hi = width;
+	for (const jcv_graphedge *e = sites[k].edges; e && lo < hi; e = e->next) {
+		if (e->neighbor == NULL) {
+			continue; /* border of the rect */
+		}
+		const int j = e->neighbor - sites;
+		const jcv_point a = sites[min(k, j)].p;
+		const jcv_point b = sites[max(k, j)].p;
+		const double dx = (double)b.x - a.x;
+		const double dy = (double)b.y - a.y;
+		const double r = ((double)b.x * b.x + (double)b.y * b.y) - ((double)a.x * a.x + (double)a.y * a.y);
+
+		/* p is closer to b where 2 * dot(p, b - a) > r */
+		const int is_b = k > j;
+		if (dx == 0.0) {
+			if ((2.0 * yc * dy > r) != is_b) {
+				hi = lo;
+			}
+			continue;
+		}
+
+		/* first pixel whose center is on b's side when dx > 0, or on a's
+		 * side when dx < 0 */
+		const double t = (r - 2.0 * yc * dy) / (2.0 * dx);
+		const int split = (int)min(max(ceil(t - 0.5), -1.0), width + 1.0);
+		if ((dx > 0.0) == is_b) {
+			lo = max(lo, split);
+		} else {
+			hi = min(hi, split);
+		}
+	}
+
+	*x0 = min(max(lo, 0), width);
+	*x1 = max(min(hi, width), *x0);
+}
+
+static void raster_cells(void *arg, int task)
+{
+	const struct raster_job *job = arg;
+	struct cellmap *map = job->map;
+	const int first = task * CELLMAP_TASK_CELLS;
+	const int last = min(first + CELLMAP_TASK_CELLS, map->ncell);
+
+	for (int k = first; k < last; k++) {
+		struct cell_info *info = &map->cell[k];
+		info->size = 0;
+		info->minx = map->width;
+		info->maxx = -1;
+		info->miny = map->height;
+		info->maxy = -1;
+
+		for (int i = 0; i < info->nspan; i++) {
+			struct cell_span *s = &map->span[info->span + i];
+			cell_span(job->sites, k, s->y + 0.5f, map->width, &s->x0, &s->x1);
+			if (s->x0 == s->x1) {
+				continue;
+			}
+
+			int *row = &map->id[(size_t)s->y * map->width];
+			for (int x = s->x0; x < s->x1; x++) {
+				row[x] = k;
+			}
+			info->size += s->x1 - s->x0;
+			info->minx = min(info->minx, s->x0);
+			info->maxx = max(info->maxx, s->x1 - 1);
+			info->miny = min(info->miny, s->y);
+			info->maxy = max(info->maxy, s->y);
+		}
+	}
+}
+
+void cellmap_build(struct cellmap *map, int *id, const jcv_diagram *diagram, int width, int height, struct pool *pool)
+{
+	const size_t size = (size_t)width * height;
+
+	map->width = width;
+	map->height = height;
+	map->ncell = diagram->internal ? diagram->numsites : 0;
+	map->id = id;
+	map->cell = malloc(max(map->ncell, 1) * sizeof(struct cell_info));
+	for (size_t i = 0; i < size; i++) {
+		map->id[i] = -1;
+	}
+
+	if (map->ncell == 0) {
+		map->span = NULL;
+		return;
+	}
+
+	/* one span per row of every cell, laid out before the cells are filled
+	 * in parallel */
+	const jcv_site *sites = jcv_diagram_get_sites(diagram);
+	int nspan = 0;
+	for (int k = 0; k < map->ncell; k++) {
+		int y0, y1;
+		cell_rows(&sites[k], height, &y0, &y1);
+		map->cell[k].span = nspan;
+		map->cell[k].nspan = y1 - y0;
+		nspan += y1 - y0;
+	}
+	map->span = malloc(max(nspan, 1) * sizeof(struct cell_span));
+	for (int k = 0; k < map->ncell; k++) {
+		int y0, y1;
+		cell_rows(&sites[k], height, &y0, &y1);
+		for (int i = 0; i < map->cell[k].nspan; i++) {
+			map->span[map->cell[k].span + i].y = y0 + i;
+		}
+	}
+
+	struct raster_job job = { .map = map, .sites = sites };
+	pool_run(pool, (map->ncell + CELLMAP_TASK_CELLS - 1) / CELLMAP_TASK_CELLS, raster_cells, &job);
+
+	/* only a pixel center right on a point shared by three bisectors can
+	 * be missed, it joins the cell to its left or above */
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int *id = &map->id[(size_t)y * width + x];
+			if (*id < 0) {
+				*id = x > 0 ? id[-1] : (y > 0 ? id[-width] : 0);
+			}
+		}
+	}
+}
+
+void cellmap_free(struct cellmap *map)
+{
+	free(map->cell);
+	free(map->span);
+	map->id = NULL;
+	map->cell = NULL;
+	map->span = NULL;
+	map->ncell = 0;
+}
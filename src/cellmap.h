@@ -0,0 +1,35 @@
+/* per-pixel raster of a voronoi diagram
+ * every cell is scan converted once into an image of cell indices and a list
+ * of row spans, so later stages find the cell of a pixel or all pixels of a
+ * cell without walking the diagram again, cell k is jcv_diagram_get_sites()[k] */
+
+struct pool;
+
+/* pixels [x0, x1) of row y */
+struct cell_span {
+	int y;
+	int x0;
+	int x1;
+};
+
+struct cell_info {
+	int size; /* in pixels */
+	int minx, miny, maxx, maxy; /* inclusive bounding box, empty cells have size 0 */
+	int span; /* first span of the cell, one span per row */
+	int nspan;
+};
+
+struct cellmap {
+	int width;
+	int height;
+	int ncell;
+	int *id; /* cell of every pixel, row-major, owned by the caller */
+	struct cell_info *cell;
+	struct cell_span *span;
+};
+
+/* the diagram must cover the rect (0, 0) to (width, height), id holds
+ * width * height ints and the map keeps pointing into it */
+void cellmap_build(struct cellmap *map, int *id, const jcv_diagram *diagram, int width, int height, struct pool *pool);
+
+void cellmap_free(struct cellmap *map);
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <math.h>
+#include "gmath.h"
+#include "pool.h"
+#include "edt.h"
+
+#define EDT_INF 1e20f
+
+/* columns and rows handed to one task */
+#define EDT_STRIP 16
+
+struct edt_job {
+	const unsigned char *mask;
+	unsigned char value;
+	int match; /* the features are the pixels that equal value, or those that do not */
+	int width;
+	int height;
+	float *dist2;
+	const float *other; /* squared distances to the complement, for edt_signed() */
+};
+
+/* d[q] = min over p of (q - p)^2 + f[p], v and z hold the parabolas of the
+ * lower envelope and the boundaries between them, z needs n + 1 entries */
+static void envelope(const float *f, float *d, int n, int *v, float *z)
+{
+	int k = 0;
+	v[0] = 0;
+	z[0] = -EDT_INF;
+	z[1] = EDT_INF;
+	for (int q = 1; q < n; q++) {
+		float s;
+		for (;;) {
+			const int p = v[k];
+			s = ((f[q] + (float)q * q) - (f[p] + (float)p * p)) / (2.f * (q - p));
+			if (s > z[k] || k == 0) {
+				break;
+			}
+			k--;
+		}
+		if (s <= z[k]) {
+			/* only the first parabola is left and the new one hides it */
+			v[0] = q;
+			z[1] = EDT_INF;
+			continue;
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k+1] = EDT_INF;
+	}
+
+	k = 0;
+	for (int q = 0; q < n; q++) {
+		while (z[k+1] < q) {
+			k++;
+		}
+		const float dq = q - v[k];
+		d[q] = dq * dq + f[v[k]];
+	}
+}
+
+static void *scratch(int n, float **f, float **d, int **v, float **z)
+{
+	char *mem = malloc(n * (3 * sizeof(float) + sizeof(int)) + sizeof(float));
+	*f = (float *)mem;
+	*d = *f + n;
+	*z = *d + n;
+	*v = (int *)(*z + n + 1);
+
+	return mem;
+}
+
+/* distance to the nearest feature up or down the column, the input is
+ * binary so a scan down and one back up are exact, both walk the strip row
+ * by row */
+static void column_strip(void *arg, int task)
+{
+	const struct edt_job *job = arg;
+	const int width = job->width;
+	const int height = job->height;
+	const int x0 = task * EDT_STRIP;
+	const int n = min(x0 + EDT_STRIP, width) - x0;
+	const int none = height + 1; /* no feature seen yet */
+
+	int gap[EDT_STRIP];
+	for (int i = 0; i < n; i++) {
+		gap[i] = none;
+	}
+	for (int y = 0; y < height; y++) {
+		const unsigned char *mask = &job->mask[(size_t)y * width + x0];
+		float *row = &job->dist2[(size_t)y * width + x0];
+		for (int i = 0; i < n; i++) {
+			const int feature = (mask[i] == job->value) == job->match;
+			gap[i] = feature ? 0 : min(gap[i] + 1, none);
+			row[i] = gap[i];
+		}
+	}
+
+	for (int i = 0; i < n; i++) {
+		gap[i] = none;
+	}
+	for (int y = height - 1; y >= 0; y--) {
+		float *row = &job->dist2[(size_t)y * width + x0];
+		for (int i = 0; i < n; i++) {
+			gap[i] = min(gap[i] + 1, (int)row[i]);
+			gap[i] = min(gap[i], none);
+			row[i] = gap[i] == none ? EDT_INF : (float)gap[i] * gap[i];
+		}
+	}
+}
+
+/* 1-d transform of the column distances along every row of the strip */
+static void row_strip(void *arg, int task)
+{
+	const struct edt_job *job = arg;
+	const int width = job->width;
+	const int y0 = task * EDT_STRIP;
+	const int y1 = min(y0 + EDT_STRIP, job->height);
+
+	float *f, *d, *z;
+	int *v;
+	void *mem = scratch(width, &f, &d, &v, &z);
+	for (int y = y0; y < y1; y++) {
+		float *row = &job->dist2[(size_t)y * width];
+		for (int x = 0; x < width; x++) {
+			f[x] = row[x];
+		}
+		envelope(f, row, width, v, z);
+	}
+	free(mem);
+}
+
+/* dist2 holds the squared distances to the outside pixels and other those
+ * to the inside ones, only one of them is nonzero per pixel */
+static void signed_strip(void *arg, int task)
+{
+	const struct edt_job *job = arg;
+	const int width = job->width;
+	const int y0 = task * EDT_STRIP;
+	const int y1 = min(y0 + EDT_STRIP, job->height);
+
+	for (size_t i = (size_t)y0 * width; i < (size_t)y1 * width; i++) {
+		if (job->mask[i] == job->value) {
+			job->dist2[i] = sqrtf(job->dist2[i]) - 0.5f;
+		} else {
+			job->dist2[i] = 0.5f - sqrtf(job->other[i]);
+		}
+	}
+}
+
+static void transform(struct edt_job *job, struct pool *pool)
+{
+	pool_run(pool, (job->width + EDT_STRIP - 1) / EDT_STRIP, column_strip, job);
+	pool_run(pool, (job->height + EDT_STRIP - 1) / EDT_STRIP, row_strip, job);
+}
+
+void edt_squared(float *dist2, const unsigned char *mask, unsigned char value, int width, int height, struct pool *pool)
+{
+	struct edt_job job = {mask, value, 1, width, height, dist2, NULL};
+	transform(&job, pool);
+}
+
+void edt_signed(float *dist, float *scratch, const unsigned char *mask, unsigned char value, int width, int height, struct pool *pool)
+{
+	float *inside = scratch;
+	struct edt_job job = {mask, value, 1, width, height, inside, NULL};
+	transform(&job, pool);
+
+	job.match = 0;
+	job.dist2 = dist;
+	transform(&job, pool);
+
+	job.other = inside;
+	pool_run(pool, (height + EDT_STRIP - 1) / EDT_STRIP, signed_strip, &job);
+}
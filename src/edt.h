@@ -0,0 +1,15 @@
+/* exact euclidean distance transform
+ * Felzenszwalb and Huttenlocher's lower envelope of parabolas, one pass down
+ * the columns and one along the rows, each linear in the number of pixels
+ * and split over the pool, the cost does not depend on the distances */
+
+struct pool;
+
+/* squared distance from every pixel center to the nearest pixel of mask
+ * that equals value, about 1e20 everywhere when there is none */
+void edt_squared(float *dist2, const unsigned char *mask, unsigned char value, int width, int height, struct pool *pool);
+
+/* signed distance to the boundary of the pixels that equal value, positive
+ * on them and negative elsewhere, the boundary runs halfway between the
+ * centers of neighboring pixels, scratch holds another width * height floats */
+void edt_signed(float *dist, float *scratch, const unsigned char *mask, unsigned char value, int width, int height, struct pool *pool);
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "gmath.h"
+#include "pool.h"
+#include "rng.h"
+#include "erode.h"
+
+/* every tile runs its share of the droplets in this many slices, so the
+ * colors take turns and no tile erodes all at once */
+#define ERODE_ROUNDS 4
+
+#define INERTIA 0.05f
+#define CAPACITY 4.f
+#define MIN_CAPACITY 0.01f
+#define DEPOSIT 0.3f
+#define ERODE 0.3f
+#define EVAPORATE 0.02f
+#define GRAVITY 4.f
+
+#define BRUSH_SIZE (2 * ERODE_RADIUS + 1)
+
+struct erode_job {
+	float *elevation;
+	int width;
+	int height;
+	int tilesx;
+	int tilesy;
+	int color; /* 0 to 3, tiles with x % 2 + 2 * (y % 2) equal to it run */
+	int round;
+	long droplets;
+	struct rng rng;
+	float brush[BRUSH_SIZE * BRUSH_SIZE]; /* weights of the eroded pixels */
+};
+
+/* bilinear height and gradient at p, the cell and its right and lower
+ * neighbors must be on the map */
+static float sample(const float *elevation, int width, float px, float py, float *gx, float *gy)
+{
+	const int x = px;
+	const int y = py;
+	const float u = px - x;
+	const float v = py - y;
+	const float *h = &elevation[(size_t)y * width + x];
+	const float h00 = h[0];
+	const float h10 = h[1];
+	const float h01 = h[width];
+	const float h11 = h[width+1];
+
+	*gx = (h10 - h00) * (1.f - v) + (h11 - h01) * v;
+	*gy = (h01 - h00) * (1.f - u) + (h11 - h10) * u;
+
+	return (h00 * (1.f - u) + h10 * u) * (1.f - v) + (h01 * (1.f - u) + h11 * u) * v;
+}
+
+static void droplet(const struct erode_job *job, float px, float py)
+{
+	float *elevation = job->elevation;
+	const int width = job->width;
+	const float lo = ERODE_RADIUS;
+	const float hix = job->width - ERODE_RADIUS - 1;
+	const float hiy = job->height - ERODE_RADIUS - 1;
+
+	float dx = 0.f;
+	float dy = 0.f;
+	float speed = 1.f;
+	float water = 1.f;
+	float sediment = 0.f;
+	for (int step = 0; step < ERODE_LIFETIME; step++) {
+		const int x = px;
+		const int y = py;
+		const float u = px - x;
+		const float v = py - y;
+
+		float gx, gy;
+		const float h = sample(elevation, width, px, py, &gx, &gy);
+		dx = dx * INERTIA - gx * (1.f - INERTIA);
+		dy = dy * INERTIA - gy * (1.f - INERTIA);
+		const float len = sqrtf(dx * dx + dy * dy);
+		if (len < 1e-6f) {
+			break;
+		}
+		dx /= len;
+		dy /= len;
+		px += dx;
+		py += dy;
+		if (px < lo || py < lo || px >= hix || py >= hiy) {
+			break;
+		}
+
+		float nx, ny;
+		const float dh = sample(elevation, width, px, py, &nx, &ny) - h;
+		const float capacity = max(-dh * speed * water * CAPACITY, MIN_CAPACITY);
+		float *cell = &elevation[(size_t)y * width + x];
+		if (sediment > capacity || dh > 0.f) {
+			/* uphill it fills the pit it left, otherwise drops the excess */
+			const float amount = dh > 0.f ? min(dh, sediment) : (sediment - capacity) * DEPOSIT;
+			sediment -= amount;
+			cell[0] += amount * (1.f - u) * (1.f - v);
+			cell[1] += amount * u * (1.f - v);
+			cell[width] += amount * (1.f - u) * v;
+			cell[width+1] += amount * u * v;
+		} else {
+			/* spread over the brush, a single pixel would dig pits */
+			const float amount = min((capacity - sediment) * ERODE, -dh);
+			const float *w = job->brush;
+			for (int by = -ERODE_RADIUS; by <= ERODE_RADIUS; by++) {
+				float *row = &elevation[(size_t)(y + by) * width + x - ERODE_RADIUS];
+				for (int bx = 0; bx < BRUSH_SIZE; bx++, w++) {
+					const float take = min(row[bx], amount * *w);
+					row[bx] -= take;
+					sediment += take;
+				}
+			}
+		}
+
+		speed = sqrtf(max(speed * speed - dh * GRAVITY, 0.f));
+		water *= 1.f - EVAPORATE;
+	}
+}
+
+/* the tile's share of this round, droplets split evenly over all slots */
+static void erode_tile(void *arg, int task)
+{
+	const struct erode_job *job = arg;
+	const int ncolor = ((job->tilesx + 1 - job->color % 2) / 2);
+	const int tx = (task % ncolor) * 2 + job->color % 2;
+	const int ty = (task / ncolor) * 2 + job->color / 2;
+	const int tile = ty * job->tilesx + tx;
+	const int64_t nslot = (int64_t)ERODE_ROUNDS * job->tilesx * job->tilesy;
+	const int64_t slot = (int64_t)job->round * job->tilesx * job->tilesy + tile;
+	const long count = job->droplets * (slot + 1) / nslot - job->droplets * slot / nslot;
+
+	const int x0 = tx * ERODE_TILE;
+	const int y0 = ty * ERODE_TILE;
+	const int tw = min(ERODE_TILE, job->width - x0);
+	const int th = min(ERODE_TILE, job->height - y0);
+	struct rng rng = rng_split(&job->rng, slot);
+	for (long i = 0; i < count; i++) {
+		const float px = x0 + rng_float(&rng) * tw;
+		const float py = y0 + rng_float(&rng) * th;
+		if (px >= ERODE_RADIUS && py >= ERODE_RADIUS && px < job->width - ERODE_RADIUS - 1 && py < job->height - ERODE_RADIUS - 1) {
+			droplet(job, px, py);
+		}
+	}
+}
+
+void erode_droplets(float *elevation, int width, int height, long droplets, const struct rng *rng, struct pool *pool)
+{
+	struct erode_job job = {
+		.elevation = elevation,
+		.width = width,
+		.height = height,
+		.tilesx = (width + ERODE_TILE - 1) / ERODE_TILE,
+		.tilesy = (height + ERODE_TILE - 1) / ERODE_TILE,
+		.droplets = droplets,
+		.rng = *rng,
+	};
+
+	float sum = 0.f;
+	for (int y = 0; y < BRUSH_SIZE; y++) {
+		for (int x = 0; x < BRUSH_SIZE; x++) {
+			const float d = sqrtf((x - ERODE_RADIUS) * (x - ERODE_RADIUS) + (y - ERODE_RADIUS) * (y - ERODE_RADIUS));
+			job.brush[y * BRUSH_SIZE + x] = max(ERODE_RADIUS + 0.5f - d, 0.f);
+			sum += job.brush[y * BRUSH_SIZE + x];
+		}
+	}
+	for (int i = 0; i < BRUSH_SIZE * BRUSH_SIZE; i++) {
+		job.brush[i] /= sum;
+	}
+
+	for (job.round = 0; job.round < ERODE_ROUNDS; job.round++) {
+		for (job.color = 0; job.color < 4; job.color++) {
+			const int nx = (job.tilesx + 1 - job.color % 2) / 2;
+			const int ny = (job.tilesy + 1 - job.color / 2) / 2;
+			pool_run(pool, nx * ny, erode_tile, &job);
+		}
+	}
+}
@@ -0,0 +1,20 @@
+/* particle hydraulic erosion
+ * droplets roll down the bilinear surface picking up sediment while they
+ * speed up and dropping it where they slow down, the map is cut in square
+ * tiles colored like a 2x2 checkerboard and the tiles of one color run in
+ * parallel, a droplet never leaves the half tile around its own so tiles of
+ * the same color touch disjoint pixels and the result does not depend on
+ * the number of threads */
+
+struct pool;
+struct rng;
+
+#define ERODE_TILE 64
+/* steps of at most one pixel each, with the brush radius and the bilinear
+ * footprint this stays below ERODE_TILE / 2 */
+#define ERODE_LIFETIME 28
+#define ERODE_RADIUS 2
+
+/* heights are in pixels, a droplet ends where it would come within the
+ * brush radius of the border */
+void erode_droplets(float *elevation, int width, int height, long droplets, const struct rng *rng, struct pool *pool);
@@ -38,12 +38,6 @@ struct rect {
 	vec2 max;
 };
 
-struct quadtree {
-	struct rect area;
-	float minheight;
-	float maxheight;
-};
-
 struct sphere {
 	vec3 c; // sphere center
 	float r; // sphere radius
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "gmath.h"
+#include "heightfield.h"
+
+typedef void (*sample_fn)(const struct heightfield *field, const float *x, const float *z, int n, float *height, vec3 *normal);
+
+static void sample_scalar(const struct heightfield *field, const float *x, const float *z, int n, float *height, vec3 *normal);
+static void detect_isa(void);
+
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+static sample_fn sample_kernel = sample_scalar;
+
+/* the surface normal of heights rising by gx and gz per world unit */
+static inline vec3 slope_normal(float gx, float gz)
+{
+	const float inv = 1.f / sqrtf(gx * gx + gz * gz + 1.f);
+	vec3 n = {{-gx * inv, inv, -gz * inv}};
+
+	return n;
+}
+
+static void sample_scalar(const struct heightfield *field, const float *x, const float *z, int n, float *height, vec3 *normal)
+{
+	const int w = field->width;
+	const float sx = field->width / field->extent;
+	const float sz = field->height / field->extent;
+	const float hscale = field->scale / 65535.f;
+
+	for (int i = 0; i < n; i++) {
+		const float px = min(max(x[i] * sx - 0.5f, 0.f), field->width - 1.f);
+		const float pz = min(max(z[i] * sz - 0.5f, 0.f), field->height - 1.f);
+		const int ix = min((int)px, field->width - 2);
+		const int iz = min((int)pz, field->height - 2);
+		const float fx = px - ix;
+		const float fz = pz - iz;
+
+		const unsigned short *row = &field->heights[(size_t)iz * w + ix];
+		const float h00 = row[0];
+		const float h10 = row[1];
+		const float h01 = row[w];
+		const float h11 = row[w+1];
+		const float top = h00 + (h10 - h00) * fx;
+		const float bottom = h01 + (h11 - h01) * fx;
+		height[i] = (top + (bottom - top) * fz) * hscale + field->offset;
+
+		if (normal) {
+			const float gx = ((h10 - h00) + ((h11 - h01) - (h10 - h00)) * fz) * hscale * sx;
+			const float gz = (bottom - top) * hscale * sz;
+			normal[i] = slope_normal(gx, gz);
+		}
+	}
+}
+
+void heightfield_sample(const struct heightfield *field, const float *x, const float *z, int n, float *height, vec3 *normal)
+{
+	pthread_once(&isa_once, detect_isa);
+	sample_kernel(field, x, z, n, height, normal);
+}
+
+float heightfield_height(const struct heightfield *field, float x, float z)
+{
+	float h;
+	sample_scalar(field, &x, &z, 1, &h, NULL);
+
+	return h;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/* one 32-bit gather fetches a texel and its right neighbor, the lower
+ * row comes from a second gather one row down */
+__attribute__((target("avx2")))
+static void sample_avx2(const struct heightfield *field, const float *x, const float *z, int n, float *height, vec3 *normal)
+{
+	const int w = field->width;
+	const float sxs = field->width / field->extent;
+	const float szs = field->height / field->extent;
+	const __m256 sx = _mm256_set1_ps(sxs);
+	const __m256 sz = _mm256_set1_ps(szs);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 maxx = _mm256_set1_ps(field->width - 1.f);
+	const __m256 maxz = _mm256_set1_ps(field->height - 1.f);
+	const __m256i lastx = _mm256_set1_epi32(field->width - 2);
+	const __m256i lastz = _mm256_set1_epi32(field->height - 2);
+	const __m256i vw = _mm256_set1_epi32(w);
+	const __m256i lo16 = _mm256_set1_epi32(0xffff);
+	const __m256 hscale = _mm256_set1_ps(field->scale / 65535.f);
+	const __m256 offset = _mm256_set1_ps(field->offset);
+	const int *base = (const int *)field->heights;
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256 px = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(&x[i]), sx), half), zero), maxx);
+		const __m256 pz = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(&z[i]), sz), half), zero), maxz);
+		const __m256i ix = _mm256_min_epi32(_mm256_cvttps_epi32(px), lastx);
+		const __m256i iz = _mm256_min_epi32(_mm256_cvttps_epi32(pz), lastz);
+		const __m256 fx = _mm256_sub_ps(px, _mm256_cvtepi32_ps(ix));
+		const __m256 fz = _mm256_sub_ps(pz, _mm256_cvtepi32_ps(iz));
+
+		/* element indices, the gathers scale them by 2 bytes */
+		const __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(iz, vw), ix);
+		const __m256i r0 = _mm256_i32gather_epi32(base, idx, 2);
+		const __m256i r1 = _mm256_i32gather_epi32(base, _mm256_add_epi32(idx, vw), 2);
+		const __m256 h00 = _mm256_cvtepi32_ps(_mm256_and_si256(r0, lo16));
+		const __m256 h10 = _mm256_cvtepi32_ps(_mm256_srli_epi32(r0, 16));
+		const __m256 h01 = _mm256_cvtepi32_ps(_mm256_and_si256(r1, lo16));
+		const __m256 h11 = _mm256_cvtepi32_ps(_mm256_srli_epi32(r1, 16));
+
+		const __m256 dtop = _mm256_sub_ps(h10, h00);
+		const __m256 dbottom = _mm256_sub_ps(h11, h01);
+		const __m256 top = _mm256_add_ps(h00, _mm256_mul_ps(dtop, fx));
+		const __m256 bottom = _mm256_add_ps(h01, _mm256_mul_ps(dbottom, fx));
+		const __m256 dz = _mm256_sub_ps(bottom, top);
+		const __m256 h = _mm256_add_ps(top, _mm256_mul_ps(dz, fz));
+		_mm256_storeu_ps(&height[i], _mm256_add_ps(_mm256_mul_ps(h, hscale), offset));
+
+		if (normal) {
+			const __m256 dx = _mm256_add_ps(dtop, _mm256_mul_ps(_mm256_sub_ps(dbottom, dtop), fz));
+			const __m256 gx = _mm256_mul_ps(_mm256_mul_ps(dx, hscale), sx);
+			const __m256 gz = _mm256_mul_ps(_mm256_mul_ps(dz, hscale), sz);
+			const __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gz, gz)), _mm256_set1_ps(1.f));
+			const __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(len2));
+			float nx[8], ny[8], nz[8];
+			_mm256_storeu_ps(nx, _mm256_mul_ps(_mm256_sub_ps(zero, gx), inv));
+			_mm256_storeu_ps(ny, inv);
+			_mm256_storeu_ps(nz, _mm256_mul_ps(_mm256_sub_ps(zero, gz), inv));
+			for (int j = 0; j < 8; j++) {
+				normal[i+j].x = nx[j];
+				normal[i+j].y = ny[j];
+				normal[i+j].z = nz[j];
+			}
+		}
+	}
+
+	sample_scalar(field, &x[i], &z[i], n - i, &height[i], normal ? &normal[i] : NULL);
+}
+
+static void detect_isa(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		sample_kernel = sample_avx2;
+	}
+}
+#else
+static void detect_isa(void)
+{
+}
+#endif
@@ -0,0 +1,24 @@
+/* CPU queries of the terrain surface
+ * positions are world units as the terrain shader places them: the map spans
+ * [0, extent] along x and z, texel centers sit where GL puts them and the
+ * height is the 16-bit sample times scale plus offset, outside the map the
+ * border texels are clamped instead of repeated */
+
+#define TERRAIN_EXTENT 64.f /* world units covered by the heightmap */
+#define TERRAIN_SCALE 4.f /* world height of a full-range sample */
+#define TERRAIN_OFFSET 1.f
+
+struct heightfield {
+	const unsigned short *heights; /* row-major, row z, not owned */
+	int width; /* at least 2 in both directions */
+	int height;
+	float extent;
+	float scale;
+	float offset;
+};
+
+/* bilinear heights of n positions, normal may be NULL, the batch runs 8
+ * positions per step where the cpu has avx2 */
+void heightfield_sample(const struct heightfield *field, const float *x, const float *z, int n, float *height, vec3 *normal);
+
+float heightfield_height(const struct heightfield *field, float x, float z);
@@ -0,0 +1,358 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gmath.h"
+#include "hydro.h"
+
+#define HYDRO_OPEN 254 /* not reached by the flood yet */
+
+const int hydro_dx[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+const int hydro_dy[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+/* direction from a neighbor back to the cell, d + 4 mod 8 */
+#define REVERSE(d) (((d) + 4) & 7)
+
+/* 8-neighbors of i that are inside the grid, returns their number */
+static inline int neighbors(int i, int width, int height, int *nb, int *dirs)
+{
+	const int x = i % width;
+	const int y = i / width;
+
+	/* most cells are away from the border */
+	if (x > 0 && y > 0 && x < width - 1 && y < height - 1) {
+		for (int d = 0; d < 8; d++) {
+			nb[d] = i + hydro_dy[d] * width + hydro_dx[d];
+			dirs[d] = d;
+		}
+		return 8;
+	}
+
+	int n = 0;
+	for (int d = 0; d < 8; d++) {
+		const int nx = x + hydro_dx[d];
+		const int ny = y + hydro_dy[d];
+		if (nx >= 0 && ny >= 0 && nx < width && ny < height) {
+			nb[n] = ny * width + nx;
+			dirs[n] = d;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+static int is_seed(int i, const unsigned char *outlet, int width, int height)
+{
+	const int x = i % width;
+	const int y = i / width;
+
+	return (outlet && outlet[i]) || x == 0 || y == 0 || x == width - 1 || y == height - 1;
+}
+
+/* the flood sets every cell to drain into the cell that reached it, which
+ * is the only way out of a filled flat, but outside of flats the steepest
+ * descent on the filled surface makes nicer rivers, a strictly lower
+ * neighbor always left the flood earlier so the order stays valid */
+static void steepest_descent_u16(const unsigned short *filled, unsigned char *dir, int width, int height)
+{
+	for (int y = 1; y < height - 1; y++) {
+		for (int x = 1; x < width - 1; x++) {
+			const int i = y * width + x;
+			if (dir[i] == HYDRO_OUTLET) {
+				continue;
+			}
+			float best = 0.f;
+			for (int d = 0; d < 8; d++) {
+				const int n = i + hydro_dy[d] * width + hydro_dx[d];
+				const float drop = (float)(filled[i] - filled[n]) * ((d & 1) ? (float)M_SQRT1_2 : 1.f);
+				if (drop > best) {
+					best = drop;
+					dir[i] = d;
+				}
+			}
+		}
+	}
+}
+
+static void steepest_descent_float(const float *filled, unsigned char *dir, int width, int height)
+{
+	for (int y = 1; y < height - 1; y++) {
+		for (int x = 1; x < width - 1; x++) {
+			const int i = y * width + x;
+			if (dir[i] == HYDRO_OUTLET) {
+				continue;
+			}
+			float best = 0.f;
+			for (int d = 0; d < 8; d++) {
+				const int n = i + hydro_dy[d] * width + hydro_dx[d];
+				const float drop = (filled[i] - filled[n]) * ((d & 1) ? (float)M_SQRT1_2 : 1.f);
+				if (drop > best) {
+					best = drop;
+					dir[i] = d;
+				}
+			}
+		}
+	}
+}
+
+void hydro_flood_u16(const unsigned short *elevation, const unsigned char *outlet, int width, int height, unsigned short *filled, unsigned char *dir, int *order, int *next)
+{
+	const int size = width * height;
+
+	/* one FIFO per height level, linked through next */
+	int *head = malloc(65536 * sizeof(int));
+	int *tail = malloc(65536 * sizeof(int));
+	for (int i = 0; i < 65536; i++) {
+		head[i] = tail[i] = -1;
+	}
+
+#define PUSH(level, cell) do { \
+	next[cell] = -1; \
+	if (tail[level] < 0) { head[level] = (cell); } else { next[tail[level]] = (cell); } \
+	tail[level] = (cell); \
+} while (0)
+
+	memset(dir, HYDRO_OPEN, size);
+	for (int i = 0; i < size; i++) {
+		if (is_seed(i, outlet, width, height)) {
+			filled[i] = elevation[i];
+			dir[i] = HYDRO_OUTLET;
+			PUSH(elevation[i], i);
+		}
+	}
+
+	int norder = 0;
+	for (int level = 0; level < 65536; level++) {
+		while (head[level] >= 0) {
+			const int c = head[level];
+			head[level] = next[c];
+			if (head[level] < 0) {
+				tail[level] = -1;
+			}
+			order[norder++] = c;
+
+			int nb[8], dirs[8];
+			const int n = neighbors(c, width, height, nb, dirs);
+			for (int k = 0; k < n; k++) {
+				const int i = nb[k];
+				if (dir[i] != HYDRO_OPEN) {
+					continue;
+				}
+				/* a neighbor below the water level is raised to it */
+				const unsigned short f = max(elevation[i], filled[c]);
+				filled[i] = f;
+				dir[i] = REVERSE(dirs[k]);
+				PUSH(f, i);
+			}
+		}
+	}
+#undef PUSH
+
+	free(tail);
+	free(head);
+
+	steepest_descent_u16(filled, dir, width, height);
+}
+
+struct heap_entry {
+	float key;
+	int cell;
+};
+
+struct heap {
+	struct heap_entry *e;
+	int n;
+	int cap;
+};
+
+static void heap_push(struct heap *h, float key, int cell)
+{
+	if (h->n == h->cap) {
+		h->cap = h->cap ? 2 * h->cap : 4096;
+		h->e = realloc(h->e, h->cap * sizeof(struct heap_entry));
+	}
+
+	int i = h->n++;
+	while (i > 0) {
+		const int parent = (i - 1) / 2;
+		if (h->e[parent].key <= key) {
+			break;
+		}
+		h->e[i] = h->e[parent];
+		i = parent;
+	}
+	h->e[i].key = key;
+	h->e[i].cell = cell;
+}
+
+static int heap_pop(struct heap *h)
+{
+	const int top = h->e[0].cell;
+	const struct heap_entry last = h->e[--h->n];
+
+	int i = 0;
+	for (;;) {
+		int child = 2 * i + 1;
+		if (child >= h->n) {
+			break;
+		}
+		if (child + 1 < h->n && h->e[child+1].key < h->e[child].key) {
+			child++;
+		}
+		if (last.key <= h->e[child].key) {
+			break;
+		}
+		h->e[i] = h->e[child];
+		i = child;
+	}
+	h->e[i] = last;
+
+	return top;
+}
+
+void hydro_flood_float(const float *elevation, const unsigned char *outlet, int width, int height, float *filled, unsigned char *dir, int *order)
+{
+	const int size = width * height;
+	struct heap heap = {0};
+
+	/* cells raised to the level of the cell that reached them go through a
+	 * plain FIFO, they are popped before anything higher in the heap */
+	int *pit = malloc(size * sizeof(int));
+	int pithead = 0;
+	int pittail = 0;
+
+	memset(dir, HYDRO_OPEN, size);
+	for (int i = 0; i < size; i++) {
+		if (is_seed(i, outlet, width, height)) {
+			filled[i] = elevation[i];
+			dir[i] = HYDRO_OUTLET;
+			heap_push(&heap, elevation[i], i);
+		}
+	}
+
+	int norder = 0;
+	while (pithead < pittail || heap.n > 0) {
+		const int c = pithead < pittail ? pit[pithead++] : heap_pop(&heap);
+		order[norder++] = c;
+
+		int nb[8], dirs[8];
+		const int n = neighbors(c, width, height, nb, dirs);
+		for (int k = 0; k < n; k++) {
+			const int i = nb[k];
+			if (dir[i] != HYDRO_OPEN) {
+				continue;
+			}
+			dir[i] = REVERSE(dirs[k]);
+			if (elevation[i] <= filled[c]) {
+				filled[i] = filled[c];
+				pit[pittail++] = i;
+			} else {
+				filled[i] = elevation[i];
+				heap_push(&heap, elevation[i], i);
+			}
+		}
+	}
+
+	free(heap.e);
+	free(pit);
+
+	steepest_descent_float(filled, dir, width, height);
+}
+
+void hydro_accumulate(const unsigned char *dir, const int *order, int width, int height, float *accum)
+{
+	const int size = width * height;
+	for (int i = 0; i < size; i++) {
+		accum[i] = 1.f;
+	}
+
+	/* upstream cells come last in the flood order */
+	for (int k = size - 1; k >= 0; k--) {
+		const int i = order[k];
+		const int d = dir[i];
+		if (d != HYDRO_OUTLET) {
+			accum[i + hydro_dy[d] * width + hydro_dx[d]] += accum[i];
+		}
+	}
+}
+
+/* Tarboton's facets, facet d spans neighbors d and d + 1, one of which is a
+ * side neighbor at distance 1 and the other a corner at sqrt(2) */
+void hydro_dinf_u16(const unsigned short *filled, int width, int height, unsigned char *dir, float *frac)
+{
+	const float quarter = (float)M_PI_4;
+	for (int i = 0; i < width * height; i++) {
+		frac[i] = 1.f;
+	}
+
+	for (int y = 1; y < height - 1; y++) {
+		for (int x = 1; x < width - 1; x++) {
+			const int i = y * width + x;
+			if (dir[i] == HYDRO_OUTLET) {
+				continue;
+			}
+			/* the slope of every facet picks it, the angle that splits the
+			 * flow is only needed for the steepest */
+			float best = 0.f;
+			float bs1 = 0.f, bs2 = 0.f;
+			int bd = -1;
+			for (int d = 0; d < 8; d++) {
+				const int e = (d + 1) & 7;
+				/* side neighbor and corner of the facet */
+				const int side = (d & 1) ? e : d;
+				const int corner = (d & 1) ? d : e;
+				const float h0 = filled[i];
+				const float hs = filled[i + hydro_dy[side] * width + hydro_dx[side]];
+				const float hc = filled[i + hydro_dy[corner] * width + hydro_dx[corner]];
+				float s1 = h0 - hs;
+				float s2 = hs - hc;
+				float slope;
+				if (s2 <= 0.f) {
+					/* toward the side neighbor */
+					s2 = 0.f;
+					slope = s1;
+				} else if (s2 >= s1) {
+					/* toward the corner */
+					s1 = s2 = 1.f;
+					slope = (h0 - hc) * (float)M_SQRT1_2;
+				} else {
+					slope = sqrtf(s1 * s1 + s2 * s2);
+				}
+				if (slope > best) {
+					best = slope;
+					bs1 = s1;
+					bs2 = s2;
+					bd = d;
+				}
+			}
+			if (bd >= 0) {
+				/* the share of the corner grows with the angle */
+				const float tocorner = min(atan2f(bs2, bs1) / quarter, 1.f);
+				dir[i] = bd;
+				frac[i] = (bd & 1) ? tocorner : 1.f - tocorner;
+			}
+		}
+	}
+}
+
+void hydro_accumulate_dinf(const unsigned char *dir, const float *frac, const int *order, int width, int height, float *accum)
+{
+	const int size = width * height;
+	for (int i = 0; i < size; i++) {
+		accum[i] = 1.f;
+	}
+
+	for (int k = size - 1; k >= 0; k--) {
+		const int i = order[k];
+		const int d = dir[i];
+		if (d == HYDRO_OUTLET) {
+			continue;
+		}
+		const float f = frac[i];
+		accum[i + hydro_dy[d] * width + hydro_dx[d]] += f * accum[i];
+		if (f < 1.f) {
+			const int e = (d + 1) & 7;
+			accum[i + hydro_dy[e] * width + hydro_dx[e]] += (1.f - f) * accum[i];
+		}
+	}
+}
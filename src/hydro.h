@@ -0,0 +1,36 @@
+/* hydrology on a height grid
+ * priority-flood fills every depression and gives each cell a D8 flow
+ * direction, every cell drains to an outlet or the map border without ever
+ * flowing uphill, the order cells leave the flood in is a topological order
+ * of the flow so accumulation is a single pass */
+
+#define HYDRO_OUTLET 255 /* direction of outlets and border cells */
+
+/* neighbor d of cell (x, y) is (x + hydro_dx[d], y + hydro_dy[d]) */
+extern const int hydro_dx[8];
+extern const int hydro_dy[8];
+
+/* integer heights, a bucket queue makes it linear in the number of cells
+ * outlet may be NULL, otherwise cells where it is nonzero drain like the
+ * border, filled gets the depression-free heights, order all cells from
+ * downstream to upstream, next is scratch of width * height ints that links
+ * the queue */
+void hydro_flood_u16(const unsigned short *elevation, const unsigned char *outlet, int width, int height, unsigned short *filled, unsigned char *dir, int *order, int *next);
+
+/* float heights on a binary heap, O(n log n) in the worst case but cells
+ * raised inside a depression skip the heap */
+void hydro_flood_float(const float *elevation, const unsigned char *outlet, int width, int height, float *filled, unsigned char *dir, int *order);
+
+/* number of cells draining through every cell, itself included */
+void hydro_accumulate(const unsigned char *dir, const int *order, int width, int height, float *accum);
+
+/* D-infinity directions on the filled heights of a flood, the flow leaves
+ * down the steepest of the 8 triangular facets around a cell and is split
+ * between the two neighbors of the facet, dir gets the first one and frac
+ * its share, the rest goes to neighbor dir + 1 mod 8, cells without a
+ * downhill facet, the flats, keep the D8 direction of the flood whole */
+void hydro_dinf_u16(const unsigned short *filled, int width, int height, unsigned char *dir, float *frac);
+
+/* hydro_accumulate() for the split flow of hydro_dinf_u16(), only strictly
+ * lower neighbors get a share so the order of the flood still holds */
+void hydro_accumulate_dinf(const unsigned char *dir, const float *frac, const int *order, int width, int height, float *accum);
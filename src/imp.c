@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 #include "gmath.h"
@@ -6,8 +8,9 @@
 #include "imp.h"
 #define JC_VORONOI_IMPLEMENTATION
 #include "voronoi.h"
+#define IIR_GAUSS_BLUR_IMPLEMENTATION
+#include "gauss.h"
 
-#define OCTAVES 5
 #define NSITES 500
 #define NRIVERS 10
 
@@ -16,36 +19,177 @@ static int pop(vec_int_t *stack, int *x, int *y);
 static inline int orient(float x0, float y0, float x1, float y1, float x2, float y2);
 static inline int min3(int a, int b, int c);
 static inline int max3(int a, int b, int c);
-static inline vec4 permute(vec4 v);
-static inline float mod(float x, float y);
-static inline float noise(float x, float y);
-static inline float smooth(float x, float y, float s);
-static inline int permutation(int x, int y);
+static int find_root(int *parent, int i);
+static int merge_labels(int *parent, int a, int b);
 
-static const int SEED = 444;
+static int format_size(enum image_format format)
+{
+	switch (format) {
+	case IMAGE_U16: return sizeof(unsigned short);
+	case IMAGE_F32: return sizeof(float);
+	default: return 1;
+	}
+}
+
+struct image image_make(int width, int height, int nchannels, enum image_format format)
+{
+	struct image image = image_wrap(NULL, width, height, nchannels, format);
+	image.stride = (image.stride + IMAGE_ALIGN - 1) & ~(size_t)(IMAGE_ALIGN - 1);
+	image.storage = aligned_alloc(IMAGE_ALIGN, max(image.stride * height, IMAGE_ALIGN));
+	image.data = image.storage;
+
+	return image;
+}
 
-void plot(int x, int y, unsigned char *image, int width, int height, int nchannels, unsigned char *color)
+struct image image_wrap(void *data, int width, int height, int nchannels, enum image_format format)
 {
-	if (x < 0 || y < 0 || x > (width-1) || y > (height-1)) {
+	struct image image = {
+		.width = width,
+		.height = height,
+		.nchannels = nchannels,
+		.format = format,
+		.pixsize = nchannels * format_size(format),
+		.data = data,
+	};
+	image.stride = (size_t)width * image.pixsize;
+
+	return image;
+}
+
+struct image image_view(const struct image *image, int x, int y, int width, int height)
+{
+	const int x0 = min(max(x, 0), image->width);
+	const int y0 = min(max(y, 0), image->height);
+	const int x1 = min(max(x + width, x0), image->width);
+	const int y1 = min(max(y + height, y0), image->height);
+
+	struct image view = *image;
+	view.width = x1 - x0;
+	view.height = y1 - y0;
+	view.data = (unsigned char *)image_row(image, y0) + (size_t)x0 * image->pixsize;
+	view.storage = NULL;
+
+	return view;
+}
+
+void image_free(struct image *image)
+{
+	free(image->storage);
+	image->storage = NULL;
+	image->data = NULL;
+}
+
+/* the recursive gaussian of iir_gauss_blur() along one line of floats,
+ * step floats apart, forward then backward in place */
+static void iir_line(float *p, size_t step, int n, const float b[4], float B)
+{
+	float prev1 = p[0], prev2 = prev1, prev3 = prev1;
+	for (int i = 0; i < n; i++) {
+		const float val = B * p[i*step] + (b[1] * prev1 + b[2] * prev2 + b[3] * prev3) / b[0];
+		p[i*step] = val;
+		prev3 = prev2;
+		prev2 = prev1;
+		prev1 = val;
+	}
+
+	prev1 = prev2 = prev3 = p[(size_t)(n - 1) * step];
+	for (int i = n - 1; i >= 0; i--) {
+		const float val = B * p[i*step] + (b[1] * prev1 + b[2] * prev2 + b[3] * prev3) / b[0];
+		p[i*step] = val;
+		prev3 = prev2;
+		prev2 = prev1;
+		prev1 = val;
+	}
+}
+
+void image_gauss_blur(struct image *image, float sigma)
+{
+	const int width = image->width;
+	const int height = image->height;
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+
+	if (image->format == IMAGE_U8) {
+		/* the vendored filter wants packed rows */
+		const size_t row = (size_t)width * image->pixsize;
+		if (image->stride == row) {
+			iir_gauss_blur(width, height, image->nchannels, image->data, sigma);
+			return;
+		}
+		unsigned char *packed = malloc(row * height);
+		for (int y = 0; y < height; y++) {
+			memcpy(&packed[y * row], image_row(image, y), row);
+		}
+		iir_gauss_blur(width, height, image->nchannels, packed, sigma);
+		for (int y = 0; y < height; y++) {
+			memcpy(image_row(image, y), &packed[y * row], row);
+		}
+		free(packed);
 		return;
 	}
 
-	int index = y * width * nchannels + x * nchannels;
+	if (image->format != IMAGE_F32) {
+		return;
+	}
 
-	for (int i = 0; i < nchannels; i++) {
-		image[index+i] = color[i];
+	/* coefficients of iir_gauss_blur(), equations 11b, 8c and 10 of Young
+	 * and van Vliet */
+	float q;
+	if (sigma >= 2.5f) {
+		q = 0.98711f * sigma - 0.96330f;
+	} else if (sigma >= 0.5f) {
+		q = 3.97156f - 4.14554f * sqrtf(1.f - 0.26891f * sigma);
+	} else {
+		return;
+	}
+	const float b[4] = {
+		1.57825f + 2.44413f * q + 1.4281f * q * q + 0.422205f * q * q * q,
+		2.44413f * q + 2.85619f * q * q + 1.26661f * q * q * q,
+		-(1.4281f * q * q + 1.26661f * q * q * q),
+		0.422205f * q * q * q,
+	};
+	const float B = 1.f - (b[1] + b[2] + b[3]) / b[0];
+
+	const int nc = image->nchannels;
+	const size_t step = image->stride / sizeof(float);
+	for (int y = 0; y < height; y++) {
+		float *r = image_row(image, y);
+		for (int c = 0; c < nc; c++) {
+			iir_line(r + c, nc, width, b, B);
+		}
+	}
+	for (int x = 0; x < width; x++) {
+		float *col = (float *)image->data + (size_t)x * nc;
+		for (int c = 0; c < nc; c++) {
+			iir_line(col + c, step, height, b, B);
+		}
+	}
+}
+
+void plot(int x, int y, struct image *image, const void *color)
+{
+	if (x < 0 || y < 0 || x > (image->width-1) || y > (image->height-1)) {
+		return;
+	}
+
+	unsigned char *pixel = (unsigned char *)image_row(image, y) + (size_t)x * image->pixsize;
+	if (image->pixsize == 1) {
+		*pixel = *(const unsigned char *)color;
+	} else {
+		memcpy(pixel, color, image->pixsize);
 	}
 }
 
 // http://members.chello.at/~easyfilter/bresenham.html
-void draw_line(int x0, int y0, int x1, int y1, unsigned char *image, int width, int height, int nchannels, unsigned char* color)
+void draw_line(int x0, int y0, int x1, int y1, struct image *image, const void *color)
 {
 	int dx =  abs(x1-x0), sx = x0<x1 ? 1 : -1;
 	int dy = -abs(y1-y0), sy = y0<y1 ? 1 : -1;
 	int err = dx+dy, e2; // error value e_xy
 
 	for(;;) {
-		plot(x0,y0, image, width, height, nchannels, color);
+		plot(x0,y0, image, color);
 		if (x0==x1 && y0==y1)
 			break;
 		e2 = 2*err;
@@ -54,7 +198,7 @@ void draw_line(int x0, int y0, int x1, int y1, unsigned char *image, int width,
 	}
 }
 
-void draw_thick_line(int x0, int y0, int x1, int y1, unsigned char *image, int width, int height, int nchannels, unsigned char *color, float wd)
+void draw_thick_line(int x0, int y0, int x1, int y1, struct image *image, const void *color, float wd)
 {
 	int dx = abs(x1-x0), sx = x0 < x1 ? 1 : -1;
 	int dy = abs(y1-y0), sy = y0 < y1 ? 1 : -1;
@@ -62,19 +206,19 @@ void draw_thick_line(int x0, int y0, int x1, int y1, unsigned char *image, int w
 	float ed = dx+dy == 0 ? 1 : sqrt((float)dx*dx+(float)dy*dy);
 
 	for (wd = (wd+1)/2; ; ) {                                   /* pixel loop */
-		plot(x0,y0, image, width, height, nchannels, color);
+		plot(x0,y0, image, color);
 		//plot(x0,y0, image, width, height, nchannels, max(0,255*(abs(err-dx+dy)/ed-wd+1)));
 		e2 = err; x2 = x0;
 		if (2*e2 >= -dx) {                                           /* x step */
 			for (e2 += dy, y2 = y0; e2 < ed*wd && (y1 != y2 || dx > dy); e2 += dx)
-				plot(x0, y2 += sy, image, width, height, nchannels, color);
+				plot(x0, y2 += sy, image, color);
 			if (x0 == x1) 
 				break;
 			e2 = err; err -= dy; x0 += sx;
 		}
 		if (2*e2 <= dy) {                                            /* y step */
 			for (e2 = dx-e2; e2 < ed*wd && (x1 != x2 || dx < dy); e2 += dy)
-				plot(x2 += sx, y0, image, width, height, nchannels, color);
+				plot(x2 += sx, y0, image, color);
 			if (y0 == y1) 
 				break;
 			err += dx; y0 += sy;
@@ -82,7 +226,7 @@ void draw_thick_line(int x0, int y0, int x1, int y1, unsigned char *image, int w
 	}
 }
 
-void draw_triangle(float x0, float y0, float x1, float y1, float x2, float y2, unsigned char *image, int width, int height, int nchannel, unsigned char *color)
+void draw_triangle(float x0, float y0, float x1, float y1, float x2, float y2, struct image *image, const void *color)
 {
 	int area = orient(x0, y0, x1, y1, x2, y2);
 	if (area == 0)
@@ -97,8 +241,8 @@ void draw_triangle(float x0, float y0, float x1, float y1, float x2, float y2, u
 	// Clip against screen bounds
 	minX = max(minX, 0);
 	minY = max(minY, 0);
-	maxX = min(maxX, width - 1);
-	maxY = min(maxY, height - 1);
+	maxX = min(maxX, image->width - 1);
+	maxY = min(maxY, image->height - 1);
 
 	// Rasterize
 	float px, py;
@@ -111,13 +255,13 @@ void draw_triangle(float x0, float y0, float x1, float y1, float x2, float y2, u
 
 			// If p is on or inside all edges, render pixel.
 			if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
-				plot((int)px, (int)py, image, width, height, nchannel, color);
+				plot((int)px, (int)py, image, color);
 			}
 		}
 	}
 }
 
-void draw_dist_triangle(float centerx, float centery, float x1, float y1, float x2, float y2, unsigned char *image, int width, int height)
+void draw_dist_triangle(float centerx, float centery, float x1, float y1, float x2, float y2, struct image *image)
 {
 	int area = orient(centerx, centery, x1, y1, x2, y2);
 	if (area == 0)
@@ -132,8 +276,8 @@ void draw_dist_triangle(float centerx, float centery, float x1, float y1, float
 	// Clip against screen bounds
 	minX = max(minX, 0);
 	minY = max(minY, 0);
-	maxX = min(maxX, width - 1);
-	maxY = min(maxY, height - 1);
+	maxX = min(maxX, image->width - 1);
+	maxY = min(maxY, image->height - 1);
 
 	// Rasterize
 	float px, py;
@@ -150,15 +294,19 @@ void draw_dist_triangle(float centerx, float centery, float x1, float y1, float
 				vec2 a = {px, py};
 				vec2 b = {centerx, centery};
 				float dist = 1.0 - (vec2_dist(a, b) / 150.0);
-				unsigned char dist_color[3] = {255.0*dist, 255.0*dist, 255.0*dist};
-				plot((int)px, (int)py, image, width, height, 3, dist_color);
+				unsigned char dist_color[image->nchannels];
+				memset(dist_color, 255.0*dist, image->nchannels);
+				plot((int)px, (int)py, image, dist_color);
 			}
 		}
 	}
 }
 
-int floodfill(int x, int y, unsigned char *image, int width, int height, unsigned char old, unsigned char new)
+int floodfill(int x, int y, struct image *image, unsigned char old, unsigned char new)
 {
+	const int width = image->width;
+	const int height = image->height;
+
 	if(old == new) {
 		return 1;
 	}
@@ -172,29 +320,32 @@ int floodfill(int x, int y, unsigned char *image, int width, int height, unsigne
 	push(&stack, x, y);
 
 	while (pop(&stack, &x, &y)) {
+		unsigned char *row = image_row(image, y);
+		const unsigned char *up = y > 0 ? row - image->stride : NULL;
+		const unsigned char *down = y < height - 1 ? row + image->stride : NULL;
 		x1 = x;
 
-		while (x1 >= 0 && image[y * width + x1] == old) {
+		while (x1 >= 0 && row[x1] == old) {
 			x1--;
 		}
 
 		x1++;
 		above = below = 0;
-		while (x1 < width && image[y * width + x1] == old) {
-			image[y * width + x1] = new;
+		while (x1 < width && row[x1] == old) {
+			row[x1] = new;
 			size++;
 
-			if (!above && y > 0 && image[(y - 1) * width + x1] == old) {
+			if (!above && up && up[x1] == old) {
 				push(&stack, x1, y - 1);
 				above = 1;
-			} else if(above && y > 0 && image[(y - 1) * width + x1] != old) {
+			} else if(above && up && up[x1] != old) {
 				above = 0;
 			}
 
-			if (!below && y < height - 1 && image[(y + 1) * width + x1] == old) {
+			if (!below && down && down[x1] == old) {
 				push(&stack, x1, y + 1);
 				below = 1;
-			} else if (below && y < height - 1 && image[(y + 1) * width + x1] != old) {
+			} else if (below && down && down[x1] != old) {
 				below = 0;
 			}
 
@@ -206,7 +357,80 @@ int floodfill(int x, int y, unsigned char *image, int width, int height, unsigne
 	return size;
 }
 
-void make_river(const jcv_diagram *diagram, unsigned char *image, int width, int height)
+/* two-pass union-find labeling: provisional labels always point to a smaller
+ * or equal label, so one forward sweep over the parents flattens them */
+int label_components(const struct image *image, int *labels, struct component **components)
+{
+	const int width = image->width;
+	const int height = image->height;
+	const size_t size = (size_t)width * height;
+	int *parent = malloc(size * sizeof(int));
+	int nlabels = 0;
+
+	for (int y = 0; y < height; y++) {
+		const unsigned char *row = image_row(image, y);
+		const unsigned char *prev = y > 0 ? row - image->stride : NULL;
+		int *lrow = &labels[(size_t)y * width];
+		for (int x = 0; x < width; x++) {
+			const unsigned char v = row[x];
+			const int left = (x > 0 && row[x-1] == v) ? lrow[x-1] : -1;
+			const int up = (prev && prev[x] == v) ? lrow[x-width] : -1;
+
+			if (left < 0 && up < 0) {
+				parent[nlabels] = nlabels;
+				lrow[x] = nlabels++;
+			} else if (up < 0) {
+				lrow[x] = left;
+			} else if (left < 0 || left == up) {
+				lrow[x] = up;
+			} else {
+				lrow[x] = merge_labels(parent, left, up);
+			}
+		}
+	}
+
+	int ncomponents = 0;
+	for (int i = 0; i < nlabels; i++) {
+		if (parent[i] < i) {
+			parent[i] = parent[parent[i]];
+		} else {
+			parent[i] = ncomponents++;
+		}
+	}
+
+	struct component *comp = malloc(ncomponents * sizeof(struct component));
+	for (int i = 0; i < ncomponents; i++) {
+		comp[i].size = 0;
+		comp[i].minx = width;
+		comp[i].miny = height;
+		comp[i].maxx = -1;
+		comp[i].maxy = -1;
+	}
+
+	for (int y = 0; y < height; y++) {
+		const unsigned char *row = image_row(image, y);
+		int *lrow = &labels[(size_t)y * width];
+		for (int x = 0; x < width; x++) {
+			const int label = parent[lrow[x]];
+			struct component *c = &comp[label];
+			lrow[x] = label;
+			if (c->size++ == 0) {
+				c->value = row[x];
+				c->miny = y;
+			}
+			c->maxy = y;
+			c->minx = min(c->minx, x);
+			c->maxx = max(c->maxx, x);
+		}
+	}
+
+	free(parent);
+
+	*components = comp;
+	return ncomponents;
+}
+
+void make_river(const jcv_diagram *diagram, struct image *image)
 {
 	//frand(time(NULL));
     	unsigned char color_line[] = {0.0, 0.0, 0.0};
@@ -226,13 +450,16 @@ void make_river(const jcv_diagram *diagram, unsigned char *image, int width, int
 	}
 
 	for (int i = 0; i < RIVER_SIZE-1; i++) {
-		draw_thick_line(x[i], y[i], x[i+1], y[i+1], image, width, height, 3, color_line, 24.0);
+		draw_thick_line(x[i], y[i], x[i+1], y[i+1], image, color_line, 24.0);
 	}
 
 }
 
-void do_voronoi(int width, int height, unsigned char *image)
+void do_voronoi(struct image *image)
 {
+	const int width = image->width;
+	const int height = image->height;
+
 	jcv_point site[NSITES];
 
 	for (int i = 0; i < NSITES; i++) {
@@ -251,7 +478,7 @@ void do_voronoi(int width, int height, unsigned char *image)
 		const jcv_site *site = &sites[i];
 		jcv_point p = site->p;
 
-		plot((int)p.x, (int)p.y, image, width, height, 3, sitecolor);
+		plot((int)p.x, (int)p.y, image, sitecolor);
 	}
 
 	/* fill the cells */
@@ -266,7 +493,7 @@ void do_voronoi(int width, int height, unsigned char *image)
 		const jcv_graphedge *e = site->edges;
 
 		while (e) {
-			draw_triangle(site->p.x, site->p.y, e->pos[0].x, e->pos[0].y, e->pos[1].x, e->pos[1].y, image, width, height, 3, rcolor);
+			draw_triangle(site->p.x, site->p.y, e->pos[0].x, e->pos[0].y, e->pos[1].x, e->pos[1].y, image, rcolor);
 			e = e->next;
 		}
 	}
@@ -274,7 +501,7 @@ void do_voronoi(int width, int height, unsigned char *image)
 	jcv_diagram_free(&diagram);
 }
 
-void make_mountains(const jcv_diagram *diagram, unsigned char *image, int width, int height)
+void make_mountains(const jcv_diagram *diagram, struct image *image)
 {
 	//frand(time(NULL));
     	unsigned char color_line[] = {255.0, 255.0, 255.0};
@@ -292,20 +519,23 @@ void make_mountains(const jcv_diagram *diagram, unsigned char *image, int width,
 		/*
 		x[i] = (int)site->p.x;
 		y[i] = (int)site->p.y;
-		draw_triangle(&site->p, &e->pos[0], &e->pos[1], image, width, height, color_line);
+		draw_triangle(&site->p, &e->pos[0], &e->pos[1], image, color_line);
 		*/
 		while (e) {
-			draw_dist_triangle(site->p.x, site->p.y, e->pos[0].x, e->pos[0].y, e->pos[1].x, e->pos[1].y, image, width, height);
+			draw_dist_triangle(site->p.x, site->p.y, e->pos[0].x, e->pos[0].y, e->pos[1].x, e->pos[1].y, image);
 			e = e->next;
 		}
 	}
 }
 
-void voronoi_rivers(int width, int height, unsigned char *image)
+void voronoi_rivers(struct image *image)
 {
+	const int width = image->width;
+	const int height = image->height;
+
 	frand(time(NULL));
-	for (int i = 0; i < 3 * width*height; i++) {
-		image[i] = 255.0;
+	for (int y = 0; y < height; y++) {
+		memset(image_row(image, y), 255, (size_t)width * image->pixsize);
 	}
 	jcv_point site[NSITES];
 
@@ -319,7 +549,7 @@ void voronoi_rivers(int width, int height, unsigned char *image)
 	jcv_diagram_generate(NSITES, site, 0, 0, &diagram);
 
 	for (int i = 0; i < NRIVERS; i++) {
-		make_river(&diagram, image, width, height);
+		make_river(&diagram, image);
 	}
 
 	jcv_diagram_free(&diagram);
@@ -335,8 +565,10 @@ static inline jcv_point remap(const jcv_point* pt, const jcv_point* min, const j
 }
 
 
-static void draw_mountains(const jcv_diagram *diagram, unsigned char *image, int width, int height)
+static void draw_mountains(const jcv_diagram *diagram, struct image *image)
 {
+ const int width = image->width;
+ const int height = image->height;
  unsigned char rgb[] = {255.0, 255.0, 255.0};
  const jcv_site *sites = jcv_diagram_get_sites(diagram);
  int nsites = diagram->numsites;
@@ -354,7 +586,7 @@ static void draw_mountains(const jcv_diagram *diagram, unsigned char *image, int
    jcv_point p0 = remap(&ge->pos[0], &diagram->min, &diagram->max, width, height);
    jcv_point p1 = remap(&ge->pos[1], &diagram->min, &diagram->max, width, height);
 
-   draw_triangle(s.x, s.y, p0.x, p0.y, p1.x, p1.y, image, width, height, 1, &rgb[0]);
+   draw_triangle(s.x, s.y, p0.x, p0.y, p1.x, p1.y, image, &rgb[0]);
    ge = ge->next;
   }
 
@@ -383,8 +615,11 @@ static void draw_mountains(const jcv_diagram *diagram, unsigned char *image, int
  }
 }
 
-void voronoi_mountains(int width, int height, unsigned char *image)
+void voronoi_mountains(struct image *image)
 {
+	const int width = image->width;
+	const int height = image->height;
+
 	frand(time(NULL));
 	srand(time(0)); 
 
@@ -399,60 +634,12 @@ void voronoi_mountains(int width, int height, unsigned char *image)
 	memset(&diagram, 0, sizeof(jcv_diagram));
 	jcv_diagram_generate(NSITES, site, 0, 0, &diagram);
 
-	draw_mountains(&diagram, image, width, height);
-	draw_mountains(&diagram, image, width, height);
+	draw_mountains(&diagram, image);
+	draw_mountains(&diagram, image);
 
 	jcv_diagram_free(&diagram);
 }
 
-float fbm_noise(float x, float y, float freq, float lacun, float gain) 
-{
-	float n = 0.0;
-	float div = 0.0;
-	float ampl = 1.0;
-
-	for (int i = 0; i < OCTAVES; i++) {
-		//n += ampl * ((1.0 - fabs(noise(x*freq, y*freq))) * 2.0 - 1.0);
-		n += ampl * fabs(noise(x*freq, y*freq));
-		div += 256 * ampl;
-		x *= lacun; 
-		y *= lacun;
-		ampl /= gain;
-	}
-
-	return n /= div;
-}
-
-float worley_noise(float x, float y)
-{
-	const float K = 1.0/7.0;
-	const float K2 = 0.5/7.0;
-	const float jitter = 0.8; // jitter 1.0 makes F1 wrong more often
-
-	vec2 Pi = {mod(floor(x), 289.0), mod(floor(y), 289.0)};
-	vec2 Pf = {fract(x), fract(y)};
-	vec4 Pfx = {Pf.x - 0.5, Pf.x - 1.5, Pf.x - 0.5, Pf.x - 1.5};
-	vec4 Pfy = {Pf.y - 0.5, Pf.y - 0.5, Pf.y - 1.5, Pf.y - 1.5};
-
-	vec4 p = {Pi.x + 0.0, Pi.x + 1.0, Pi.x + 0.0, Pi.x + 1.0};
-	p = permute(p);
-	vec4 pp = {p.x + Pi.y + 0.0, p.y + Pi.y + 0.0, p.z + Pi.y + 1.0, p.w + Pi.y + 1.0};
-	p = permute(pp);
-	vec4 ox = {mod(p.x, 7.0) * K + K2, mod(p.y, 7.0) * K + K2, mod(p.z, 7.0) * K + K2, mod(p.w, 7.0) * K + K2};
-	vec4 oy = {mod(floor(p.x * K) ,7.0) * K + K2, mod(floor(p.y * K) ,7.0) * K + K2, mod(floor(p.z * K) ,7.0) * K + K2, mod(floor(p.w * K) ,7.0) * K + K2};
-	vec4 dx = {Pfx.x + jitter * ox.x, Pfx.y + jitter * ox.y, Pfx.z + jitter * ox.z, Pfx.w + jitter * ox.w};
-	vec4 dy = {Pfy.x + jitter * oy.x, Pfy.y + jitter * oy.y, Pfy.z + jitter * oy.z, Pfy.w + jitter * oy.w};
-	vec4 d = {dx.x * dx.x + dy.x * dy.x, dx.y * dx.y + dy.y * dy.y, dx.z * dx.z + dy.z * dy.z, dx.w * dx.w + dy.w * dy.w}; // d i s t a n c e s squared
-	// Cheat and pick only F1 for the return value
-	d.x = min(d.x, d.z);
-	d.y = min(d.y, d.w);
-	d.x = min(d.x , d.y);
-	return clamp(d.x, 0.0, 1.0); // F1 duplicated , F2 not computed
-}
-
-
-
-
 static void push(vec_int_t *stack, int x, int y)
 {
 	vec_push(stack, x);
@@ -470,76 +657,41 @@ static int pop(vec_int_t *stack, int *x, int *y)
 	return 1;
 }
 
-// http://fgiesen.wordpress.com/2013/02/08/triangle-rasterization-in-practice/
-static inline int orient(float x0, float y0, float x1, float y1, float x2, float y2)
+static int find_root(int *parent, int i)
 {
-	return ((int)x1 - (int)x0)*((int)y2 - (int)y0) - ((int)y1 - (int)y0)*((int)x2 - (int)x0);
-}
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
 
-static inline int min3(int a, int b, int c)
-{
-	return min(a, min(b, c));
-}
-static inline int max3(int a, int b, int c)
-{
-	return max(a, max(b, c));
+	return i;
 }
 
-static inline int permutation(int x, int y)
+/* joins the sets of a and b, the smaller root becomes the new root */
+static int merge_labels(int *parent, int a, int b)
 {
-	const int hash_table[] = {
-	208,34,231,213,32,248,233,56,161,78,24,140,71,48,140,254,245,255,247,247,40,
-	185,248,251,245,28,124,204,204,76,36,1,107,28,234,163,202,224,245,128,167,204,
-	9,92,217,54,239,174,173,102,193,189,190,121,100,108,167,44,43,77,180,204,8,81,
-	70,223,11,38,24,254,210,210,177,32,81,195,243,125,8,169,112,32,97,53,195,13,
-	203,9,47,104,125,117,114,124,165,203,181,235,193,206,70,180,174,0,167,181,41,
-	164,30,116,127,198,245,146,87,224,149,206,57,4,192,210,65,210,129,240,178,105,
-	228,108,245,148,140,40,35,195,38,58,65,207,215,253,65,85,208,76,62,3,237,55,89,
-	232,50,217,64,244,157,199,121,252,90,17,212,203,149,152,140,187,234,177,73,174,
-	193,100,192,143,97,53,145,135,19,103,13,90,135,151,199,91,239,247,33,39,145,
-	101,120,99,3,186,86,99,41,237,203,111,79,220,135,158,42,30,154,120,67,87,167,
-	135,176,183,191,253,115,184,21,233,58,129,233,142,39,128,211,118,137,139,255,
-	114,20,218,113,154,27,127,246,250,1,8,198,250,209,92,222,173,21,88,102,219
-	};
-	int tmp = hash_table[(y + SEED) % 256];
-	return hash_table[(tmp + x) % 256];
-}
+	a = find_root(parent, a);
+	b = find_root(parent, b);
+	if (a < b) {
+		parent[b] = a;
+		return a;
+	}
+	parent[a] = b;
 
-static inline float smooth(float x, float y, float s)
-{
-	return lerp(x, y, s * s * (3-2*s));
+	return b;
 }
 
-static inline float noise(float x, float y)
+// http://fgiesen.wordpress.com/2013/02/08/triangle-rasterization-in-practice/
+static inline int orient(float x0, float y0, float x1, float y1, float x2, float y2)
 {
-	int ix = x;
-	int iy = y;
-
-	/* square gradients */
-	int s = permutation(ix, iy);
-	int t = permutation(ix+1, iy);
-	int u = permutation(ix, iy+1);
-	int v = permutation(ix+1, iy+1);
-
-	float low = smooth(s, t, fract(x));
-	float high = smooth(u, v, fract(x));
-
-	return smooth(low, high, fract(y));
+	return ((int)x1 - (int)x0)*((int)y2 - (int)y0) - ((int)y1 - (int)y0)*((int)x2 - (int)x0);
 }
 
-static inline float mod(float x, float y)
+static inline int min3(int a, int b, int c)
 {
-	return x - y * floorf(x/y);
+	return min(a, min(b, c));
 }
-
-static inline vec4 permute(vec4 v)
+static inline int max3(int a, int b, int c)
 {
-	vec4 tmp = {
-		mod((34.0 * v.x + 1.0) * v.x, 289.0), 
-		mod((34.0 * v.y + 1.0) * v.y, 289.0), 
-		mod((34.0 * v.z + 1.0) * v.z, 289.0), 
-		mod((34.0 * v.w + 1.0) * v.w, 289.0)
-	};
-	return tmp;
+	return max(a, max(b, c));
 }
-
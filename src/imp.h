@@ -1,29 +1,75 @@
 /* image manipulation library */
 
+enum image_format {
+	IMAGE_U8,
+	IMAGE_U16,
+	IMAGE_F32,
+};
+
+#define IMAGE_ALIGN 64 /* rows of allocated images start on a cache line */
+
+/* a view of rows of pixels, views of a part of an image share its pixels */
 struct image {
 	int width; /* in pixels */
 	int height; /* in pixels */
-	unsigned char *data; /* raw image data */
 	int nchannels; /* amount of channels, example: rgb has 3 */
-	size_t size; /* size in bytes */
+	enum image_format format; /* of every channel */
+	int pixsize; /* bytes per pixel */
+	size_t stride; /* bytes from one row to the next */
+	unsigned char *data; /* first channel of the top left pixel */
+	void *storage; /* what image_free() releases, NULL for views */
 };
 
-void plot(int x, int y, unsigned char *image, int width, int height, int nchannels, unsigned char *color);
+/* uninitialized, every row aligned to IMAGE_ALIGN */
+struct image image_make(int width, int height, int nchannels, enum image_format format);
+
+/* rows packed without padding, the pixels stay owned by the caller */
+struct image image_wrap(void *data, int width, int height, int nchannels, enum image_format format);
+
+/* the rectangle clipped to the image, no pixels are copied */
+struct image image_view(const struct image *image, int x, int y, int width, int height);
+
+void image_free(struct image *image);
+
+static inline void *image_row(const struct image *image, int y)
+{
+	return image->data + (size_t)y * image->stride;
+}
+
+/* gaussian blur of every channel of a u8 or f32 image in place, with the
+ * recursive filter of gauss.h, other formats are left as they are */
+void image_gauss_blur(struct image *image, float sigma);
+
+/* color holds nchannels values of the image format, pixels outside the
+ * image are skipped */
+void plot(int x, int y, struct image *image, const void *color);
+
+/* single channel u8 images */
+int floodfill(int x, int y, struct image *image, unsigned char old, unsigned char new);
+
+/* 4-connected region of pixels that share the same value */
+struct component {
+	int size; /* in pixels */
+	unsigned char value; /* value of every pixel in the component */
+	int minx, miny, maxx, maxy; /* inclusive bounding box */
+};
 
-int floodfill(int x, int y, unsigned char *image, int width, int height, unsigned char old, unsigned char new);
+/* writes the component index of every pixel of a single channel u8 image to
+ * labels, which are packed width by height, and returns the number of
+ * components, the caller frees the components array */
+int label_components(const struct image *image, int *labels, struct component **components);
 
-void draw_line(int x0, int y0, int x1, int y1, unsigned char* image, int width, int height, int nchannels, unsigned char* color);
+void draw_line(int x0, int y0, int x1, int y1, struct image *image, const void *color);
 
-void draw_thick_line(int x0, int y0, int x1, int y1, unsigned char* image, int width, int height, int nchannels, unsigned char *color, float wd);
+void draw_thick_line(int x0, int y0, int x1, int y1, struct image *image, const void *color, float wd);
 
-void draw_triangle(float x0, float y0, float x1, float y1, float x2, float y2, unsigned char *image, int width, int height, int nchannel, unsigned char *color);
+void draw_triangle(float x0, float y0, float x1, float y1, float x2, float y2, struct image *image, const void *color);
 
-void draw_dist_triangle(float centerx, float centery, float x1, float y1, float x2, float y2, unsigned char *image, int width, int height);
+/* u8 images, every channel fades with the distance to the center */
+void draw_dist_triangle(float centerx, float centery, float x1, float y1, float x2, float y2, struct image *image);
 
-/* voronoi diagram */
-void do_voronoi(int width, int height, unsigned char *image);
-void voronoi_rivers(int width, int height, unsigned char *image);
-void voronoi_mountains(int width, int height, unsigned char *image);
+/* voronoi diagram, on rgb u8 images */
+void do_voronoi(struct image *image);
+void voronoi_rivers(struct image *image);
+void voronoi_mountains(struct image *image);
 
-float fbm_noise(float x, float y, float freq, float lacun, float gain);
-float worley_noise(float x, float y);
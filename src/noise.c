@@ -0,0 +1,624 @@
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "gmath.h"
+#include "pool.h"
+#include "noise.h"
+#include "trace.h"
+
+#define OCTAVES 5
+#define FIELD_TILE_ROWS 16
+
+enum field_type {
+	FIELD_FBM,
+	FIELD_WORLEY,
+};
+
+struct field_job {
+	enum field_type type;
+	float *field;
+	int width;
+	int height;
+	double scalex;
+	double scaley;
+	float freq;
+	float lacun;
+	float gain;
+	int seed;
+};
+
+static inline vec4 permute(vec4 v);
+static inline float mod(float x, float y);
+static inline float noise(float x, float y, int seed);
+static inline float smooth(float x, float y, float s);
+static inline int permutation(int x, int y, int seed);
+static void field_tile(void *arg, int tile);
+static void run_field(struct field_job *job, struct pool *pool);
+static void fbm_batch_scalar(float *out, const float *x, const float *y, int n, float freq, float lacun, float gain, int seed);
+static void worley_batch_scalar(float *out, const float *x, const float *y, int n);
+static void detect_isa(void);
+
+struct noise_kernels {
+	void (*fbm)(float *out, const float *x, const float *y, int n, float freq, float lacun, float gain, int seed);
+	void (*worley)(float *out, const float *x, const float *y, int n);
+};
+
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+static enum noise_isa best_isa = NOISE_SCALAR;
+static enum noise_isa active_isa = NOISE_SCALAR;
+static struct noise_kernels kernels = { fbm_batch_scalar, worley_batch_scalar };
+
+static const int hash_table[256] = {
+208,34,231,213,32,248,233,56,161,78,24,140,71,48,140,254,245,255,247,247,40,
+185,248,251,245,28,124,204,204,76,36,1,107,28,234,163,202,224,245,128,167,204,
+9,92,217,54,239,174,173,102,193,189,190,121,100,108,167,44,43,77,180,204,8,81,
+70,223,11,38,24,254,210,210,177,32,81,195,243,125,8,169,112,32,97,53,195,13,
+203,9,47,104,125,117,114,124,165,203,181,235,193,206,70,180,174,0,167,181,41,
+164,30,116,127,198,245,146,87,224,149,206,57,4,192,210,65,210,129,240,178,105,
+228,108,245,148,140,40,35,195,38,58,65,207,215,253,65,85,208,76,62,3,237,55,89,
+232,50,217,64,244,157,199,121,252,90,17,212,203,149,152,140,187,234,177,73,174,
+193,100,192,143,97,53,145,135,19,103,13,90,135,151,199,91,239,247,33,39,145,
+101,120,99,3,186,86,99,41,237,203,111,79,220,135,158,42,30,154,120,67,87,167,
+135,176,183,191,253,115,184,21,233,58,129,233,142,39,128,211,118,137,139,255,
+114,20,218,113,154,27,127,246,250,1,8,198,250,209,92,222,173,21,88,102,219
+};
+
+float fbm_noise(float x, float y, float freq, float lacun, float gain, int seed)
+{
+	float n = 0.0;
+	float div = 0.0;
+	float ampl = 1.0;
+
+	for (int i = 0; i < OCTAVES; i++) {
+		//n += ampl * ((1.0 - fabs(noise(x*freq, y*freq))) * 2.0 - 1.0);
+		n += ampl * fabs(noise(x*freq, y*freq, seed));
+		div += 256 * ampl;
+		x *= lacun; 
+		y *= lacun;
+		ampl /= gain;
+	}
+
+	return n /= div;
+}
+
+float worley_noise(float x, float y)
+{
+	const float K = 1.0/7.0;
+	const float K2 = 0.5/7.0;
+	const float jitter = 0.8; // jitter 1.0 makes F1 wrong more often
+
+	vec2 Pi = {mod(floor(x), 289.0), mod(floor(y), 289.0)};
+	vec2 Pf = {fract(x), fract(y)};
+	vec4 Pfx = {Pf.x - 0.5, Pf.x - 1.5, Pf.x - 0.5, Pf.x - 1.5};
+	vec4 Pfy = {Pf.y - 0.5, Pf.y - 0.5, Pf.y - 1.5, Pf.y - 1.5};
+
+	vec4 p = {Pi.x + 0.0, Pi.x + 1.0, Pi.x + 0.0, Pi.x + 1.0};
+	p = permute(p);
+	vec4 pp = {p.x + Pi.y + 0.0, p.y + Pi.y + 0.0, p.z + Pi.y + 1.0, p.w + Pi.y + 1.0};
+	p = permute(pp);
+	vec4 ox = {mod(p.x, 7.0) * K + K2, mod(p.y, 7.0) * K + K2, mod(p.z, 7.0) * K + K2, mod(p.w, 7.0) * K + K2};
+	vec4 oy = {mod(floor(p.x * K) ,7.0) * K + K2, mod(floor(p.y * K) ,7.0) * K + K2, mod(floor(p.z * K) ,7.0) * K + K2, mod(floor(p.w * K) ,7.0) * K + K2};
+	vec4 dx = {Pfx.x + jitter * ox.x, Pfx.y + jitter * ox.y, Pfx.z + jitter * ox.z, Pfx.w + jitter * ox.w};
+	vec4 dy = {Pfy.x + jitter * oy.x, Pfy.y + jitter * oy.y, Pfy.z + jitter * oy.z, Pfy.w + jitter * oy.w};
+	vec4 d = {dx.x * dx.x + dy.x * dy.x, dx.y * dx.y + dy.y * dy.y, dx.z * dx.z + dy.z * dy.z, dx.w * dx.w + dy.w * dy.w}; // d i s t a n c e s squared
+	// Cheat and pick only F1 for the return value
+	d.x = min(d.x, d.z);
+	d.y = min(d.y, d.w);
+	d.x = min(d.x , d.y);
+	return clamp(d.x, 0.0, 1.0); // F1 duplicated , F2 not computed
+}
+
+void fbm_field(float *field, int width, int height, double scale, float freq, float lacun, float gain, int seed, struct pool *pool)
+{
+	struct field_job job = {
+		.type = FIELD_FBM,
+		.field = field,
+		.width = width,
+		.height = height,
+		.scalex = scale,
+		.scaley = scale,
+		.freq = freq,
+		.lacun = lacun,
+		.gain = gain,
+		.seed = seed,
+	};
+
+	run_field(&job, pool);
+}
+
+void worley_field(float *field, int width, int height, double scalex, double scaley, struct pool *pool)
+{
+	struct field_job job = {
+		.type = FIELD_WORLEY,
+		.field = field,
+		.width = width,
+		.height = height,
+		.scalex = scalex,
+		.scaley = scaley,
+	};
+
+	run_field(&job, pool);
+}
+
+static void run_field(struct field_job *job, struct pool *pool)
+{
+	int ntiles = (job->height + FIELD_TILE_ROWS - 1) / FIELD_TILE_ROWS;
+	pool_run(pool, ntiles, field_tile, job);
+}
+
+/* every pixel only depends on its own coordinates so tiles can run in any order */
+static void field_tile(void *arg, int tile)
+{
+	const struct field_job *job = arg;
+	const int y0 = tile * FIELD_TILE_ROWS;
+	const int y1 = min(y0 + FIELD_TILE_ROWS, job->height);
+
+	trace_begin(job->type == FIELD_FBM ? "fbm tile" : "worley tile");
+	float *xs = malloc(2 * job->width * sizeof(float));
+	trace_alloc(2 * job->width * sizeof(float));
+	float *ys = xs + job->width;
+	for (int x = 0; x < job->width; x++) {
+		xs[x] = job->scalex * x;
+	}
+
+	for (int y = y0; y < y1; y++) {
+		float *row = &job->field[(size_t)y * job->width];
+		const float sy = job->scaley * y;
+		for (int x = 0; x < job->width; x++) {
+			ys[x] = sy;
+		}
+		if (job->type == FIELD_FBM) {
+			fbm_noise_batch(row, xs, ys, job->width, job->freq, job->lacun, job->gain, job->seed);
+		} else {
+			worley_noise_batch(row, xs, ys, job->width);
+		}
+	}
+
+	free(xs);
+	trace_end();
+}
+
+void fbm_noise_batch(float *out, const float *x, const float *y, int n, float freq, float lacun, float gain, int seed)
+{
+	pthread_once(&isa_once, detect_isa);
+	kernels.fbm(out, x, y, n, freq, lacun, gain, seed);
+}
+
+void worley_noise_batch(float *out, const float *x, const float *y, int n)
+{
+	pthread_once(&isa_once, detect_isa);
+	kernels.worley(out, x, y, n);
+}
+
+static void fbm_batch_scalar(float *out, const float *x, const float *y, int n, float freq, float lacun, float gain, int seed)
+{
+	for (int i = 0; i < n; i++) {
+		out[i] = fbm_noise(x[i], y[i], freq, lacun, gain, seed);
+	}
+}
+
+static void worley_batch_scalar(float *out, const float *x, const float *y, int n)
+{
+	for (int i = 0; i < n; i++) {
+		out[i] = worley_noise(x[i], y[i]);
+	}
+}
+
+/* the low seed byte shifts the rows of the hash, the next byte the columns */
+static inline int permutation(int x, int y, int seed)
+{
+	int tmp = hash_table[(y + seed) & 255];
+	return hash_table[(tmp + x + (seed >> 8)) & 255];
+}
+
+static inline float smooth(float x, float y, float s)
+{
+	return lerp(x, y, s * s * (3-2*s));
+}
+
+static inline float noise(float x, float y, int seed)
+{
+	int ix = x;
+	int iy = y;
+
+	/* square gradients */
+	int s = permutation(ix, iy, seed);
+	int t = permutation(ix+1, iy, seed);
+	int u = permutation(ix, iy+1, seed);
+	int v = permutation(ix+1, iy+1, seed);
+
+	float low = smooth(s, t, fract(x));
+	float high = smooth(u, v, fract(x));
+
+	return smooth(low, high, fract(y));
+}
+
+static inline float mod(float x, float y)
+{
+	return x - y * floorf(x/y);
+}
+
+static inline vec4 permute(vec4 v)
+{
+	vec4 tmp = {
+		mod((34.0 * v.x + 1.0) * v.x, 289.0), 
+		mod((34.0 * v.y + 1.0) * v.y, 289.0), 
+		mod((34.0 * v.z + 1.0) * v.z, 289.0), 
+		mod((34.0 * v.w + 1.0) * v.w, 289.0)
+	};
+	return tmp;
+}
+
+
+/* SIMD kernels
+ *
+ * The scalar path rounds in a particular order: lerp() does (1.0 - t) * a in
+ * double but t * b in float, and fbm_noise() accumulates through fabs() in
+ * double. The vector code repeats those steps in the same precision so that
+ * the batch output is bit-identical to the scalar functions.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("sse4.1")))
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t)
+{
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128 tb = _mm_mul_ps(t, b);
+	const __m128 th = _mm_movehl_ps(t, t);
+	const __m128 ah = _mm_movehl_ps(a, a);
+	const __m128 tbh = _mm_movehl_ps(tb, tb);
+
+	__m128d lo = _mm_add_pd(_mm_mul_pd(_mm_sub_pd(one, _mm_cvtps_pd(t)), _mm_cvtps_pd(a)), _mm_cvtps_pd(tb));
+	__m128d hi = _mm_add_pd(_mm_mul_pd(_mm_sub_pd(one, _mm_cvtps_pd(th)), _mm_cvtps_pd(ah)), _mm_cvtps_pd(tbh));
+
+	return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 smooth4(__m128 a, __m128 b, __m128 s)
+{
+	const __m128 w = _mm_mul_ps(_mm_mul_ps(s, s), _mm_sub_ps(_mm_set1_ps(3.f), _mm_mul_ps(_mm_set1_ps(2.f), s)));
+	return lerp4(a, b, w);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i hashi4(__m128i i)
+{
+	return _mm_set_epi32(
+		hash_table[_mm_extract_epi32(i, 3) & 255],
+		hash_table[_mm_extract_epi32(i, 2) & 255],
+		hash_table[_mm_extract_epi32(i, 1) & 255],
+		hash_table[_mm_extract_epi32(i, 0) & 255]);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 noise4(__m128 x, __m128 y, int seed)
+{
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i ix = _mm_add_epi32(_mm_cvttps_epi32(x), _mm_set1_epi32(seed >> 8));
+	const __m128i iy = _mm_add_epi32(_mm_cvttps_epi32(y), _mm_set1_epi32(seed));
+	const __m128 fx = _mm_sub_ps(x, _mm_floor_ps(x));
+	const __m128 fy = _mm_sub_ps(y, _mm_floor_ps(y));
+
+	const __m128i row0 = _mm_add_epi32(hashi4(iy), ix);
+	const __m128i row1 = _mm_add_epi32(hashi4(_mm_add_epi32(iy, one)), ix);
+	const __m128 s = _mm_cvtepi32_ps(hashi4(row0));
+	const __m128 t = _mm_cvtepi32_ps(hashi4(_mm_add_epi32(row0, one)));
+	const __m128 u = _mm_cvtepi32_ps(hashi4(row1));
+	const __m128 v = _mm_cvtepi32_ps(hashi4(_mm_add_epi32(row1, one)));
+
+	const __m128 low = smooth4(s, t, fx);
+	const __m128 high = smooth4(u, v, fx);
+
+	return smooth4(low, high, fy);
+}
+
+__attribute__((target("sse4.1")))
+static void fbm_batch_sse41(float *out, const float *x, const float *y, int n, float freq, float lacun, float gain, int seed)
+{
+	const __m128 vfreq = _mm_set1_ps(freq);
+	const __m128 vlacun = _mm_set1_ps(lacun);
+	const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 px = _mm_loadu_ps(&x[i]);
+		__m128 py = _mm_loadu_ps(&y[i]);
+		__m128d nlo = _mm_setzero_pd();
+		__m128d nhi = _mm_setzero_pd();
+		float div = 0.0;
+		float ampl = 1.0;
+
+		for (int o = 0; o < OCTAVES; o++) {
+			const __m128 z = _mm_and_ps(noise4(_mm_mul_ps(px, vfreq), _mm_mul_ps(py, vfreq), seed), absmask);
+			const __m128d va = _mm_set1_pd(ampl);
+			/* n is a float in the scalar code, round after every octave */
+			nlo = _mm_cvtps_pd(_mm_cvtpd_ps(_mm_add_pd(nlo, _mm_mul_pd(va, _mm_cvtps_pd(z)))));
+			nhi = _mm_cvtps_pd(_mm_cvtpd_ps(_mm_add_pd(nhi, _mm_mul_pd(va, _mm_cvtps_pd(_mm_movehl_ps(z, z))))));
+			div += 256 * ampl;
+			px = _mm_mul_ps(px, vlacun);
+			py = _mm_mul_ps(py, vlacun);
+			ampl /= gain;
+		}
+
+		const __m128 sum = _mm_movelh_ps(_mm_cvtpd_ps(nlo), _mm_cvtpd_ps(nhi));
+		_mm_storeu_ps(&out[i], _mm_div_ps(sum, _mm_set1_ps(div)));
+	}
+
+	fbm_batch_scalar(&out[i], &x[i], &y[i], n - i, freq, lacun, gain, seed);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 mod4(__m128 x, __m128 y)
+{
+	return _mm_sub_ps(x, _mm_mul_ps(y, _mm_floor_ps(_mm_div_ps(x, y))));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 permute4(__m128 v)
+{
+	const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(34.f), v), _mm_set1_ps(1.f)), v);
+	return mod4(t, _mm_set1_ps(289.f));
+}
+
+/* squared distance to the jittered feature point of one of the four cells */
+__attribute__((target("sse4.1")))
+static inline __m128 feature4(__m128 p, __m128 fx, __m128 fy)
+{
+	const __m128 K = _mm_set1_ps((float)(1.0/7.0));
+	const __m128 K2 = _mm_set1_ps((float)(0.5/7.0));
+	const __m128 seven = _mm_set1_ps(7.f);
+	const __m128 jitter = _mm_set1_ps(0.8f);
+
+	const __m128 ox = _mm_add_ps(_mm_mul_ps(mod4(p, seven), K), K2);
+	const __m128 oy = _mm_add_ps(_mm_mul_ps(mod4(_mm_floor_ps(_mm_mul_ps(p, K)), seven), K), K2);
+	const __m128 dx = _mm_add_ps(fx, _mm_mul_ps(jitter, ox));
+	const __m128 dy = _mm_add_ps(fy, _mm_mul_ps(jitter, oy));
+
+	return _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+}
+
+__attribute__((target("sse4.1")))
+static void worley_batch_sse41(float *out, const float *x, const float *y, int n)
+{
+	const __m128 m = _mm_set1_ps(289.f);
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 onehalf = _mm_set1_ps(1.5f);
+
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128 px = _mm_loadu_ps(&x[i]);
+		const __m128 py = _mm_loadu_ps(&y[i]);
+		const __m128 flx = _mm_floor_ps(px);
+		const __m128 fly = _mm_floor_ps(py);
+		const __m128 pix = mod4(flx, m);
+		const __m128 piy = mod4(fly, m);
+		const __m128 pfx = _mm_sub_ps(px, flx);
+		const __m128 pfy = _mm_sub_ps(py, fly);
+
+		const __m128 p0 = _mm_add_ps(permute4(pix), piy);
+		const __m128 p1 = _mm_add_ps(permute4(_mm_add_ps(pix, one)), piy);
+
+		const __m128 d0 = feature4(permute4(p0), _mm_sub_ps(pfx, half), _mm_sub_ps(pfy, half));
+		const __m128 d1 = feature4(permute4(p1), _mm_sub_ps(pfx, onehalf), _mm_sub_ps(pfy, half));
+		const __m128 d2 = feature4(permute4(_mm_add_ps(p0, one)), _mm_sub_ps(pfx, half), _mm_sub_ps(pfy, onehalf));
+		const __m128 d3 = feature4(permute4(_mm_add_ps(p1, one)), _mm_sub_ps(pfx, onehalf), _mm_sub_ps(pfy, onehalf));
+
+		__m128 d = _mm_min_ps(_mm_min_ps(d0, d2), _mm_min_ps(d1, d3));
+		d = _mm_min_ps(_mm_max_ps(d, _mm_setzero_ps()), one);
+		_mm_storeu_ps(&out[i], d);
+	}
+
+	worley_batch_scalar(&out[i], &x[i], &y[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 lerp8(__m256 a, __m256 b, __m256 t)
+{
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256 tb = _mm256_mul_ps(t, b);
+
+	__m256d lo = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(one, _mm256_cvtps_pd(_mm256_castps256_ps128(t))), _mm256_cvtps_pd(_mm256_castps256_ps128(a))), _mm256_cvtps_pd(_mm256_castps256_ps128(tb)));
+	__m256d hi = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(one, _mm256_cvtps_pd(_mm256_extractf128_ps(t, 1))), _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1))), _mm256_cvtps_pd(_mm256_extractf128_ps(tb, 1)));
+
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 smooth8(__m256 a, __m256 b, __m256 s)
+{
+	const __m256 w = _mm256_mul_ps(_mm256_mul_ps(s, s), _mm256_sub_ps(_mm256_set1_ps(3.f), _mm256_mul_ps(_mm256_set1_ps(2.f), s)));
+	return lerp8(a, b, w);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hashi8(__m256i i)
+{
+	return _mm256_i32gather_epi32(hash_table, _mm256_and_si256(i, _mm256_set1_epi32(255)), 4);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 noise8(__m256 x, __m256 y, int seed)
+{
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i ix = _mm256_add_epi32(_mm256_cvttps_epi32(x), _mm256_set1_epi32(seed >> 8));
+	const __m256i iy = _mm256_add_epi32(_mm256_cvttps_epi32(y), _mm256_set1_epi32(seed));
+	const __m256 fx = _mm256_sub_ps(x, _mm256_floor_ps(x));
+	const __m256 fy = _mm256_sub_ps(y, _mm256_floor_ps(y));
+
+	const __m256i row0 = _mm256_add_epi32(hashi8(iy), ix);
+	const __m256i row1 = _mm256_add_epi32(hashi8(_mm256_add_epi32(iy, one)), ix);
+	const __m256 s = _mm256_cvtepi32_ps(hashi8(row0));
+	const __m256 t = _mm256_cvtepi32_ps(hashi8(_mm256_add_epi32(row0, one)));
+	const __m256 u = _mm256_cvtepi32_ps(hashi8(row1));
+	const __m256 v = _mm256_cvtepi32_ps(hashi8(_mm256_add_epi32(row1, one)));
+
+	const __m256 low = smooth8(s, t, fx);
+	const __m256 high = smooth8(u, v, fx);
+
+	return smooth8(low, high, fy);
+}
+
+__attribute__((target("avx2")))
+static void fbm_batch_avx2(float *out, const float *x, const float *y, int n, float freq, float lacun, float gain, int seed)
+{
+	const __m256 vfreq = _mm256_set1_ps(freq);
+	const __m256 vlacun = _mm256_set1_ps(lacun);
+	const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 px = _mm256_loadu_ps(&x[i]);
+		__m256 py = _mm256_loadu_ps(&y[i]);
+		__m256d nlo = _mm256_setzero_pd();
+		__m256d nhi = _mm256_setzero_pd();
+		float div = 0.0;
+		float ampl = 1.0;
+
+		for (int o = 0; o < OCTAVES; o++) {
+			const __m256 z = _mm256_and_ps(noise8(_mm256_mul_ps(px, vfreq), _mm256_mul_ps(py, vfreq), seed), absmask);
+			const __m256d va = _mm256_set1_pd(ampl);
+			/* n is a float in the scalar code, round after every octave */
+			nlo = _mm256_cvtps_pd(_mm256_cvtpd_ps(_mm256_add_pd(nlo, _mm256_mul_pd(va, _mm256_cvtps_pd(_mm256_castps256_ps128(z))))));
+			nhi = _mm256_cvtps_pd(_mm256_cvtpd_ps(_mm256_add_pd(nhi, _mm256_mul_pd(va, _mm256_cvtps_pd(_mm256_extractf128_ps(z, 1))))));
+			div += 256 * ampl;
+			px = _mm256_mul_ps(px, vlacun);
+			py = _mm256_mul_ps(py, vlacun);
+			ampl /= gain;
+		}
+
+		const __m256 sum = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(nlo)), _mm256_cvtpd_ps(nhi), 1);
+		_mm256_storeu_ps(&out[i], _mm256_div_ps(sum, _mm256_set1_ps(div)));
+	}
+
+	fbm_batch_scalar(&out[i], &x[i], &y[i], n - i, freq, lacun, gain, seed);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 mod8(__m256 x, __m256 y)
+{
+	return _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_floor_ps(_mm256_div_ps(x, y))));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 permute8(__m256 v)
+{
+	const __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(34.f), v), _mm256_set1_ps(1.f)), v);
+	return mod8(t, _mm256_set1_ps(289.f));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 feature8(__m256 p, __m256 fx, __m256 fy)
+{
+	const __m256 K = _mm256_set1_ps((float)(1.0/7.0));
+	const __m256 K2 = _mm256_set1_ps((float)(0.5/7.0));
+	const __m256 seven = _mm256_set1_ps(7.f);
+	const __m256 jitter = _mm256_set1_ps(0.8f);
+
+	const __m256 ox = _mm256_add_ps(_mm256_mul_ps(mod8(p, seven), K), K2);
+	const __m256 oy = _mm256_add_ps(_mm256_mul_ps(mod8(_mm256_floor_ps(_mm256_mul_ps(p, K)), seven), K), K2);
+	const __m256 dx = _mm256_add_ps(fx, _mm256_mul_ps(jitter, ox));
+	const __m256 dy = _mm256_add_ps(fy, _mm256_mul_ps(jitter, oy));
+
+	return _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+}
+
+__attribute__((target("avx2")))
+static void worley_batch_avx2(float *out, const float *x, const float *y, int n)
+{
+	const __m256 m = _mm256_set1_ps(289.f);
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 onehalf = _mm256_set1_ps(1.5f);
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256 px = _mm256_loadu_ps(&x[i]);
+		const __m256 py = _mm256_loadu_ps(&y[i]);
+		const __m256 flx = _mm256_floor_ps(px);
+		const __m256 fly = _mm256_floor_ps(py);
+		const __m256 pix = mod8(flx, m);
+		const __m256 piy = mod8(fly, m);
+		const __m256 pfx = _mm256_sub_ps(px, flx);
+		const __m256 pfy = _mm256_sub_ps(py, fly);
+
+		const __m256 p0 = _mm256_add_ps(permute8(pix), piy);
+		const __m256 p1 = _mm256_add_ps(permute8(_mm256_add_ps(pix, one)), piy);
+
+		const __m256 d0 = feature8(permute8(p0), _mm256_sub_ps(pfx, half), _mm256_sub_ps(pfy, half));
+		const __m256 d1 = feature8(permute8(p1), _mm256_sub_ps(pfx, onehalf), _mm256_sub_ps(pfy, half));
+		const __m256 d2 = feature8(permute8(_mm256_add_ps(p0, one)), _mm256_sub_ps(pfx, half), _mm256_sub_ps(pfy, onehalf));
+		const __m256 d3 = feature8(permute8(_mm256_add_ps(p1, one)), _mm256_sub_ps(pfx, onehalf), _mm256_sub_ps(pfy, onehalf));
+
+		__m256 d = _mm256_min_ps(_mm256_min_ps(d0, d2), _mm256_min_ps(d1, d3));
+		d = _mm256_min_ps(_mm256_max_ps(d, _mm256_setzero_ps()), one);
+		_mm256_storeu_ps(&out[i], d);
+	}
+
+	worley_batch_scalar(&out[i], &x[i], &y[i], n - i);
+}
+
+static void use_isa(enum noise_isa isa)
+{
+	switch (isa) {
+	case NOISE_AVX2:
+		kernels.fbm = fbm_batch_avx2;
+		kernels.worley = worley_batch_avx2;
+		break;
+	case NOISE_SSE41:
+		kernels.fbm = fbm_batch_sse41;
+		kernels.worley = worley_batch_sse41;
+		break;
+	default:
+		kernels.fbm = fbm_batch_scalar;
+		kernels.worley = worley_batch_scalar;
+		break;
+	}
+	active_isa = isa;
+}
+
+static void detect_isa(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		best_isa = NOISE_AVX2;
+	} else if (__builtin_cpu_supports("sse4.1")) {
+		best_isa = NOISE_SSE41;
+	}
+	use_isa(best_isa);
+}
+
+enum noise_isa noise_set_isa(enum noise_isa isa)
+{
+	pthread_once(&isa_once, detect_isa);
+	use_isa(isa > best_isa ? best_isa : isa);
+
+	return active_isa;
+}
+#else
+static void detect_isa(void)
+{
+}
+
+enum noise_isa noise_set_isa(enum noise_isa isa)
+{
+	return NOISE_SCALAR;
+}
+#endif
+
+enum noise_isa noise_get_isa(void)
+{
+	pthread_once(&isa_once, detect_isa);
+	return active_isa;
+}
+
+const char *noise_isa_name(enum noise_isa isa)
+{
+	switch (isa) {
+	case NOISE_AVX2: return "avx2";
+	case NOISE_SSE41: return "sse4.1";
+	default: return "scalar";
+	}
+}
@@ -0,0 +1,37 @@
+/* coherent noise and noise fields */
+
+struct pool;
+
+/* seed selects one of 65536 variations of the value noise */
+float fbm_noise(float x, float y, float freq, float lacun, float gain, int seed);
+
+float worley_noise(float x, float y);
+
+/* instruction sets the batch kernels can run on */
+enum noise_isa {
+	NOISE_SCALAR,
+	NOISE_SSE41, /* 4 samples per step */
+	NOISE_AVX2, /* 8 samples per step */
+};
+
+/* batch versions of the noise functions, out[i] is bit-identical to the
+ * scalar function at (x[i], y[i]), coordinates must not be negative */
+void fbm_noise_batch(float *out, const float *x, const float *y, int n, float freq, float lacun, float gain, int seed);
+
+void worley_noise_batch(float *out, const float *x, const float *y, int n);
+
+/* the best instruction set of this cpu is picked on first use, a request for
+ * an unsupported one falls back to the best available, returns the new isa */
+enum noise_isa noise_set_isa(enum noise_isa isa);
+
+enum noise_isa noise_get_isa(void);
+
+const char *noise_isa_name(enum noise_isa isa);
+
+/* fills a row-major width * height field with
+ * fbm_noise(scale * x, scale * y, freq, lacun, gain, seed), rows are split in tiles
+ * over the pool and the result is the same for any number of threads */
+void fbm_field(float *field, int width, int height, double scale, float freq, float lacun, float gain, int seed, struct pool *pool);
+
+/* fills a row-major field with worley_noise(scalex * x, scaley * y) */
+void worley_field(float *field, int width, int height, double scalex, double scaley, struct pool *pool);
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "gmath.h"
+#include "rng.h"
+#include "poisson.h"
+
+/* candidates tried around an active point before it retires */
+#define POISSON_ATTEMPTS 30
+/* random points tried inside an empty cell when looking for a new seed */
+#define POISSON_SEED_ATTEMPTS 4
+
+struct sampler {
+	const unsigned char *mask;
+	int width;
+	int height;
+	unsigned char value;
+	float radius;
+	float cellsize;
+	int gw, gh;
+	int *grid; /* index of the point in every cell, -1 when empty */
+	vec2 *points;
+	int npoints;
+};
+
+static void grid_cell(const struct sampler *s, vec2 p, int *gx, int *gy)
+{
+	*gx = min((int)(p.x / s->cellsize), s->gw - 1);
+	*gy = min((int)(p.y / s->cellsize), s->gh - 1);
+}
+
+/* p is on the mask and no earlier point lies within the radius */
+static int accept(const struct sampler *s, vec2 p)
+{
+	if (p.x < 0.f || p.y < 0.f || p.x >= s->width || p.y >= s->height) {
+		return 0;
+	}
+	if (s->mask[(int)p.y * s->width + (int)p.x] != s->value) {
+		return 0;
+	}
+
+	int gx, gy;
+	grid_cell(s, p, &gx, &gy);
+	const float r2 = s->radius * s->radius;
+	for (int y = max(gy - 2, 0); y <= min(gy + 2, s->gh - 1); y++) {
+		for (int x = max(gx - 2, 0); x <= min(gx + 2, s->gw - 1); x++) {
+			const int i = s->grid[y * s->gw + x];
+			if (i >= 0) {
+				const float dx = s->points[i].x - p.x;
+				const float dy = s->points[i].y - p.y;
+				if (dx * dx + dy * dy < r2) {
+					return 0;
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+static int insert(struct sampler *s, vec2 p)
+{
+	int gx, gy;
+	grid_cell(s, p, &gx, &gy);
+	const int i = s->npoints++;
+	s->points[i] = p;
+	s->grid[gy * s->gw + gx] = i;
+
+	return i;
+}
+
+/* grows the sample from one seed point until no active point has room left */
+static void grow(struct sampler *s, int seed, int *active, struct rng *rng)
+{
+	int nactive = 0;
+	active[nactive++] = seed;
+
+	while (nactive > 0) {
+		const int slot = rng_int(rng, nactive);
+		const vec2 center = s->points[active[slot]];
+
+		int found = 0;
+		for (int k = 0; k < POISSON_ATTEMPTS; k++) {
+			/* uniform in the annulus between radius and 2 * radius */
+			const float angle = rng_float(rng) * 2.f * M_PI;
+			const float dist = s->radius * sqrtf(1.f + 3.f * rng_float(rng));
+			const vec2 p = {{center.x + dist * cosf(angle), center.y + dist * sinf(angle)}};
+			if (accept(s, p)) {
+				active[nactive++] = insert(s, p);
+				found = 1;
+				break;
+			}
+		}
+
+		if (!found) {
+			active[slot] = active[--nactive];
+		}
+	}
+}
+
+int poisson_capacity(int width, int height, float radius)
+{
+	const float cellsize = radius / sqrtf(2.f);
+
+	return (int)ceilf(width / cellsize) * (int)ceilf(height / cellsize);
+}
+
+int poisson_disc(vec2 *points, const unsigned char *mask, int width, int height, unsigned char value, float radius, struct rng *rng)
+{
+	struct sampler s = {
+		.mask = mask,
+		.width = width,
+		.height = height,
+		.value = value,
+		.radius = radius,
+		.cellsize = radius / sqrtf(2.f),
+		.points = points,
+	};
+	s.gw = ceilf(width / s.cellsize);
+	s.gh = ceilf(height / s.cellsize);
+	s.grid = malloc(s.gw * s.gh * sizeof(int));
+	for (int i = 0; i < s.gw * s.gh; i++) {
+		s.grid[i] = -1;
+	}
+	int *active = malloc(s.gw * s.gh * sizeof(int));
+
+	/* a single seed only covers the piece of the mask it lands on, so every
+	 * cell that is still empty after the previous growth gets a few tries */
+	for (int gy = 0; gy < s.gh; gy++) {
+		for (int gx = 0; gx < s.gw; gx++) {
+			if (s.grid[gy * s.gw + gx] >= 0) {
+				continue;
+			}
+			for (int k = 0; k < POISSON_SEED_ATTEMPTS; k++) {
+				const vec2 p = {{(gx + rng_float(rng)) * s.cellsize, (gy + rng_float(rng)) * s.cellsize}};
+				if (accept(&s, p)) {
+					grow(&s, insert(&s, p), active, rng);
+					break;
+				}
+			}
+		}
+	}
+
+	free(active);
+	free(s.grid);
+
+	return s.npoints;
+}
@@ -0,0 +1,14 @@
+/* poisson-disc (blue noise) sampling inside a mask
+ * Bridson's algorithm with a background grid of cells of size radius/sqrt(2),
+ * every cell holds at most one point so a neighbor query looks at a fixed
+ * 5x5 block and the whole run is linear in the number of cells */
+
+struct rng;
+
+/* upper bound of the number of points poisson_disc() can return */
+int poisson_capacity(int width, int height, float radius);
+
+/* fills points with samples at least radius apart on the pixels of mask that
+ * equal value and returns their number, every connected piece of the mask
+ * gets seeded so islands are covered too, no points on an empty mask */
+int poisson_disc(vec2 *points, const unsigned char *mask, int width, int height, unsigned char value, float radius, struct rng *rng);
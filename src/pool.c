@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pool.h"
+#include "trace.h"
+
+struct pool {
+	int nthreads;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t wake; /* signals a new job or shutdown to the workers */
+	pthread_cond_t done; /* signals the caller that the job finished */
+	/* current job, guarded by lock */
+	void (*fn)(void *arg, int task);
+	void *arg;
+	int ntasks;
+	int next; /* next task to hand out */
+	int pending; /* tasks handed out or waiting that have not finished */
+	unsigned long generation; /* bumped for every job */
+	int quit;
+};
+
+/* takes tasks from the current job until there are none left */
+static void drain(struct pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (pool->next < pool->ntasks) {
+		int task = pool->next++;
+		void (*fn)(void *, int) = pool->fn;
+		void *arg = pool->arg;
+		pthread_mutex_unlock(&pool->lock);
+
+		fn(arg, task);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->pending == 0) {
+			pthread_cond_broadcast(&pool->done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void *worker(void *data)
+{
+	struct pool *pool = data;
+	unsigned long seen = 0;
+
+	trace_thread_name("worker");
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->quit && pool->generation == seen) {
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+		if (pool->quit) {
+			pthread_mutex_unlock(&pool->lock);
+			return NULL;
+		}
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		drain(pool);
+	}
+}
+
+struct pool *pool_create(int nthreads)
+{
+	if (nthreads <= 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nthreads <= 0) {
+			nthreads = 1;
+		}
+	}
+
+	struct pool *pool = calloc(1, sizeof(struct pool));
+	pool->nthreads = nthreads;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	/* the calling thread is the first worker */
+	pool->threads = calloc(nthreads, sizeof(pthread_t));
+	for (int i = 1; i < nthreads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker, pool) != 0) {
+			fprintf(stderr, "warning: could only start %d worker threads\n", i);
+			pool->nthreads = i;
+			break;
+		}
+	}
+
+	return pool;
+}
+
+void pool_destroy(struct pool *pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 1; i < pool->nthreads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool);
+}
+
+int pool_size(const struct pool *pool)
+{
+	return pool ? pool->nthreads : 1;
+}
+
+void pool_run(struct pool *pool, int ntasks, void (*fn)(void *arg, int task), void *arg)
+{
+	if (pool == NULL || pool->nthreads == 1 || ntasks == 1) {
+		for (int i = 0; i < ntasks; i++) {
+			fn(arg, i);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->ntasks = ntasks;
+	pool->next = 0;
+	pool->pending = ntasks;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	drain(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending > 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
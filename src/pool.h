@@ -0,0 +1,15 @@
+/* fixed set of worker threads that split a job into numbered tasks */
+
+struct pool;
+
+/* nthreads counts the calling thread, 0 uses one thread per online cpu */
+struct pool *pool_create(int nthreads);
+
+void pool_destroy(struct pool *pool);
+
+int pool_size(const struct pool *pool);
+
+/* calls fn(arg, task) for every task in [0, ntasks) and returns once all
+ * of them are done, a NULL pool runs the tasks on the calling thread
+ * tasks must not call pool_run on the same pool */
+void pool_run(struct pool *pool, int ntasks, void (*fn)(void *arg, int task), void *arg);
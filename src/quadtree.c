@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include "gmath.h"
+#include "pool.h"
+#include "quadtree.h"
+
+/* rows of a level reduced by one task */
+#define QUADTREE_STRIP 16
+
+struct reduce_job {
+	struct quadtree *tree;
+	int level; /* the level being filled from the one below */
+};
+
+static inline int level_size(int n, int level)
+{
+	return (n + (1 << level) - 1) >> level;
+}
+
+static void reduce_strip(void *arg, int task)
+{
+	const struct reduce_job *job = arg;
+	const struct quadtree *tree = job->tree;
+	const int l = job->level;
+	const int w = level_size(tree->width, l);
+	const int h = level_size(tree->height, l);
+	const int cw = level_size(tree->width, l - 1);
+	const int ch = level_size(tree->height, l - 1);
+	/* the heightmap is its own min and max */
+	const unsigned short *cmin = l == 1 ? tree->base : tree->min[l-1];
+	const unsigned short *cmax = l == 1 ? tree->base : tree->max[l-1];
+
+	const int y0 = task * QUADTREE_STRIP;
+	const int y1 = min(y0 + QUADTREE_STRIP, h);
+	for (int y = y0; y < y1; y++) {
+		const int cy0 = 2 * y;
+		const int cy1 = min(2 * y + 1, ch - 1);
+		for (int x = 0; x < w; x++) {
+			const int cx0 = 2 * x;
+			const int cx1 = min(2 * x + 1, cw - 1);
+			const size_t a = (size_t)cy0 * cw;
+			const size_t b = (size_t)cy1 * cw;
+			tree->min[l][(size_t)y * w + x] = min(min(cmin[a+cx0], cmin[a+cx1]), min(cmin[b+cx0], cmin[b+cx1]));
+			tree->max[l][(size_t)y * w + x] = max(max(cmax[a+cx0], cmax[a+cx1]), max(cmax[b+cx0], cmax[b+cx1]));
+		}
+	}
+}
+
+struct quadtree *quadtree_build(const unsigned short *heights, int width, int height, struct pool *pool)
+{
+	struct quadtree *tree = calloc(1, sizeof(struct quadtree));
+	tree->width = width;
+	tree->height = height;
+	tree->base = heights;
+
+	size_t total = 0;
+	tree->nlevel = 1;
+	while (level_size(width, tree->nlevel - 1) > 1 || level_size(height, tree->nlevel - 1) > 1) {
+		total += (size_t)level_size(width, tree->nlevel) * level_size(height, tree->nlevel);
+		tree->nlevel++;
+	}
+
+	/* one block for every level, all the minimums then all the maximums */
+	unsigned short *mem = total ? malloc(2 * total * sizeof(unsigned short)) : NULL;
+	size_t offset = 0;
+	for (int l = 1; l < tree->nlevel; l++) {
+		tree->min[l] = mem + offset;
+		tree->max[l] = mem + total + offset;
+		offset += (size_t)level_size(width, l) * level_size(height, l);
+	}
+
+	struct reduce_job job = {tree, 0};
+	for (job.level = 1; job.level < tree->nlevel; job.level++) {
+		const int rows = level_size(height, job.level);
+		pool_run(pool, (rows + QUADTREE_STRIP - 1) / QUADTREE_STRIP, reduce_strip, &job);
+	}
+
+	return tree;
+}
+
+void quadtree_free(struct quadtree *tree)
+{
+	if (tree) {
+		free(tree->min[1]);
+		free(tree);
+	}
+}
+
+void quadtree_node(const struct quadtree *tree, int level, int x, int y, unsigned short *lo, unsigned short *hi)
+{
+	if (level == 0) {
+		*lo = *hi = tree->base[(size_t)y * tree->width + x];
+		return;
+	}
+
+	const size_t i = (size_t)y * level_size(tree->width, level) + x;
+	*lo = tree->min[level][i];
+	*hi = tree->max[level][i];
+}
+
+void quadtree_bounds(const struct quadtree *tree, int x0, int y0, int x1, int y1, unsigned short *lo, unsigned short *hi)
+{
+	x0 = max(x0, 0);
+	y0 = max(y0, 0);
+	x1 = min(x1, tree->width);
+	y1 = min(y1, tree->height);
+	if (x0 >= x1 || y0 >= y1) {
+		*lo = 1;
+		*hi = 0;
+		return;
+	}
+
+	*lo = 0xffff;
+	*hi = 0;
+	/* blocks at least as big as the rectangle, it then covers two of them
+	 * at most along each axis */
+	const int extent = max(x1 - x0, y1 - y0);
+	int l = 0;
+	while ((1 << l) < extent && l < tree->nlevel - 1) {
+		l++;
+	}
+
+	for (int y = y0 >> l; y <= (y1 - 1) >> l; y++) {
+		for (int x = x0 >> l; x <= (x1 - 1) >> l; x++) {
+			unsigned short a, b;
+			quadtree_node(tree, l, x, y, &a, &b);
+			*lo = min(*lo, a);
+			*hi = max(*hi, b);
+		}
+	}
+}
@@ -0,0 +1,31 @@
+/* min/max height pyramid
+ * level l holds the lowest and highest height of every 2^l by 2^l block of
+ * the heightmap, level 0 is the heightmap itself, so the bounds of any
+ * rectangle are at most four node lookups on the level where the blocks are
+ * as big as the rectangle */
+
+struct pool;
+
+#define QUADTREE_LEVELS 32
+
+struct quadtree {
+	int width; /* of the heightmap */
+	int height;
+	int nlevel; /* levels including the heightmap, the last is one node */
+	const unsigned short *base; /* the heightmap, not owned */
+	unsigned short *min[QUADTREE_LEVELS]; /* row-major, level l is ceil(width / 2^l) wide */
+	unsigned short *max[QUADTREE_LEVELS];
+};
+
+/* the heightmap must outlive the tree, a NULL pool builds on the calling
+ * thread */
+struct quadtree *quadtree_build(const unsigned short *heights, int width, int height, struct pool *pool);
+
+void quadtree_free(struct quadtree *tree);
+
+/* bounds of the node at (x, y) of level l */
+void quadtree_node(const struct quadtree *tree, int level, int x, int y, unsigned short *lo, unsigned short *hi);
+
+/* conservative bounds of the pixels in [x0, x1) x [y0, y1), clipped to the
+ * map, lo > hi for an empty rectangle */
+void quadtree_bounds(const struct quadtree *tree, int x0, int y0, int x1, int y1, unsigned short *lo, unsigned short *hi);
@@ -0,0 +1,38 @@
+#include <stdint.h>
+#include "rng.h"
+
+/* splitmix64 finalizer */
+static inline uint64_t mix(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+struct rng rng_seed(uint64_t seed)
+{
+	struct rng rng = { mix(seed + 0x9e3779b97f4a7c15ULL), 0 };
+	return rng;
+}
+
+struct rng rng_split(const struct rng *rng, uint64_t id)
+{
+	struct rng child = { mix(rng->key ^ mix(id + 0x632be59bd9b4e019ULL)), 0 };
+	return child;
+}
+
+uint64_t rng_next(struct rng *rng)
+{
+	return mix(rng->key + (rng->counter++) * 0x9e3779b97f4a7c15ULL);
+}
+
+float rng_float(struct rng *rng)
+{
+	/* the top 24 bits fill a float mantissa exactly */
+	return (rng_next(rng) >> 40) * (1.f / 16777216.f);
+}
+
+int rng_int(struct rng *rng, int n)
+{
+	return ((rng_next(rng) >> 32) * (uint64_t)n) >> 32;
+}
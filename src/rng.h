@@ -0,0 +1,22 @@
+/* counter based random numbers
+ * every value is a hash of the stream key and a counter, so a stream can be
+ * split into independent child streams (per stage, thread or tile) without
+ * any shared state, and the same seed always gives the same world */
+
+struct rng {
+	uint64_t key;
+	uint64_t counter;
+};
+
+struct rng rng_seed(uint64_t seed);
+
+/* child stream identified by id, it does not advance the parent */
+struct rng rng_split(const struct rng *rng, uint64_t id);
+
+uint64_t rng_next(struct rng *rng);
+
+/* uniform in [0, 1) */
+float rng_float(struct rng *rng);
+
+/* uniform in [0, n) */
+int rng_int(struct rng *rng, int n);
@@ -7,6 +7,8 @@
 #include "texture.h"
 #include "gmath.h"
 #include "imp.h"
+#include "noise.h"
+#include "pool.h"
 
 static GLuint make_rgb_texture(unsigned char *buf, int width, int height);
 static void rgbchannel(rgb *image, unsigned char *buf, int width, int height);
@@ -111,10 +113,60 @@ GLuint make_r_texture(unsigned char *image, int width, int height)
 	return texnum;
 }
 
+GLuint make_r16_texture(unsigned short *image, int width, int height)
+{
+	GLuint texnum;
+
+	glGenTextures(1, &texnum);
+	glBindTexture(GL_TEXTURE_2D, texnum);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R16, width, height);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_SHORT, image);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return texnum;
+}
+
+/* two signed components per texel, read back in [-1, 1] */
+GLuint make_rg16_snorm_texture(short *image, int width, int height)
+{
+	GLuint texnum;
+
+	glGenTextures(1, &texnum);
+	glBindTexture(GL_TEXTURE_2D, texnum);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16_SNORM, width, height);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RG, GL_SHORT, image);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return texnum;
+}
+
+GLuint make_rgba8_texture(unsigned char *image, int width, int height)
+{
+	GLuint texnum;
+
+	glGenTextures(1, &texnum);
+	glBindTexture(GL_TEXTURE_2D, texnum);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return texnum;
+}
+
 GLuint make_voronoi_texture(int width, int height)
 {
 	unsigned char *buf = calloc(width * height * 3, sizeof(unsigned char));
-	do_voronoi(width, height, buf);
+	struct image image = image_wrap(buf, width, height, 3, IMAGE_U8);
+	do_voronoi(&image);
 	GLuint texnum = make_rgb_texture(buf, width, height);
 
 	free(buf);
@@ -125,7 +177,8 @@ GLuint make_voronoi_texture(int width, int height)
 GLuint make_river_texture(int width, int height)
 {
 	unsigned char *buf = calloc(width * height * 3, sizeof(unsigned char));
-	voronoi_rivers(width, height, buf);
+	struct image image = image_wrap(buf, width, height, 3, IMAGE_U8);
+	voronoi_rivers(&image);
 	GLuint texnum = make_rgb_texture(buf, width, height);
 
 	free(buf);
@@ -136,7 +189,8 @@ GLuint make_river_texture(int width, int height)
 GLuint make_mountain_texture(int width, int height)
 {
 	unsigned char *buf = calloc(width * height * 3, sizeof(unsigned char));
-	voronoi_mountains(width, height, buf);
+	struct image image = image_wrap(buf, width, height, 3, IMAGE_U8);
+	voronoi_mountains(&image);
 
 	 size_t isize = width * height * 3;
 
@@ -226,18 +280,22 @@ static void rgbchannel(rgb *image, unsigned char *buf, int width, int height)
 
 static unsigned char *gen_worley_map(int size_x, int size_y)
 {
-	unsigned char *buf = calloc(size_x*size_y, sizeof(unsigned char));
-
-	int nbuf = 0;
-	for(int x = 0; x < size_x; x++) {
-		for(int y = 0; y < size_y; y++) {
-			float z = sqrt(worley_noise(0.1*x, 0.1*y));
-			//z[i] = 1.0 - sqrt(z[i]); //if you want steep mountains
-			//z = 1.0 - z; //if you want normal mountains
-			buf[nbuf++] = 255*z;
-		}
+	const size_t len = size_x * size_y;
+	unsigned char *buf = calloc(len, sizeof(unsigned char));
+	float *field = calloc(len, sizeof(float));
+
+	struct pool *pool = pool_create(0);
+	worley_field(field, size_x, size_y, 0.1, 0.1, pool);
+	pool_destroy(pool);
+
+	for (int i = 0; i < len; i++) {
+		float z = sqrt(field[i]);
+		//z[i] = 1.0 - sqrt(z[i]); //if you want steep mountains
+		//z = 1.0 - z; //if you want normal mountains
+		buf[i] = 255*z;
 	}
 
+	free(field);
 	return buf;
 }
 
@@ -245,15 +303,16 @@ static unsigned char *gen_perlin_map(int size_x, int size_y)
 {
 	const size_t len = size_x * size_y;
 	unsigned char *buf = calloc(len, sizeof(unsigned char));
+	float *field = calloc(len, sizeof(float));
 
-	int nbuf = 0;
-	for(int x = 0; x < size_x; x++) {
-		for(int y = 0; y < size_y; y++) {
-			float z = fbm_noise(0.5*x, 0.5*y, 0.005, 2.5, 2.0);
-			buf[nbuf++] = z * 255.0;
-		}
+	struct pool *pool = pool_create(0);
+	fbm_field(field, size_x, size_y, 0.5, 0.005, 2.5, 2.0, 0, pool);
+	pool_destroy(pool);
+
+	for (int i = 0; i < len; i++) {
+		buf[i] = field[i] * 255.0;
 	}
 
+	free(field);
 	return buf;
 }
-
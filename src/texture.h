@@ -18,6 +18,12 @@ GLuint load_dds_texture(const char *fpath);
 
 GLuint make_r_texture(unsigned char *image, int width, int height);
 
+GLuint make_r16_texture(unsigned short *image, int width, int height);
+
+GLuint make_rg16_snorm_texture(short *image, int width, int height);
+
+GLuint make_rgba8_texture(unsigned char *image, int width, int height);
+
 GLuint make_voronoi_texture(int width, int height);
 
 GLuint make_mountain_texture(int width, int height);
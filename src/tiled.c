@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include "gmath.h"
+#include "noise.h"
+#include "pool.h"
+#include "rng.h"
+#include "trace.h"
+#include "world.h"
+#include "tiled.h"
+
+/* rng stream of the detail noise, far from the ids of the stages */
+#define TILED_STREAM 0x7469
+
+struct tile_job {
+	const struct world *overview;
+	int res; /* of the heightmap */
+	int tile;
+	int y0; /* first row of the band */
+	int y1;
+	double scale; /* overview pixels per heightmap pixel */
+	int seed;
+	unsigned short *band; /* rows y0 to y1 */
+};
+
+/* catmull-rom weights of the 4 samples around t in [0, 1) */
+static inline void cubic_weights(float t, float w[4])
+{
+	w[0] = ((-t + 2.f) * t - 1.f) * t * 0.5f;
+	w[1] = ((3.f * t - 5.f) * t * t + 2.f) * 0.5f;
+	w[2] = ((-3.f * t + 4.f) * t + 1.f) * t * 0.5f;
+	w[3] = (t - 1.f) * t * t * 0.5f;
+}
+
+/* the overview sample under the center of heightmap pixel x, texel centers
+ * line up as they do when GL magnifies a texture */
+static inline float overview_coord(int x, double scale)
+{
+	return (x + 0.5) * scale - 0.5;
+}
+
+/* the overview is interpolated down the columns under the tile and a halo
+ * of the taps beyond its edges once per row, then along the row once per
+ * pixel, the halo is read from the overview so no tile waits for another */
+static void bake_tile(void *arg, int task)
+{
+	const struct tile_job *job = arg;
+	const struct world *ov = job->overview;
+	const int ores = ov->resolution;
+	const int x0 = task * job->tile;
+	const int x1 = min(x0 + job->tile, job->res);
+	const int n = x1 - x0;
+	const int c0 = (int)floorf(overview_coord(x0, job->scale)) - 1;
+	const int c1 = (int)floorf(overview_coord(x1 - 1, job->scale)) + 2;
+	const int ncol = c1 - c0 + 1;
+
+	trace_begin("tile");
+	float *scratch = malloc((3 * ncol + 7 * n) * sizeof(float));
+	float *height = scratch;
+	float *land = height + ncol;
+	float *river = land + ncol;
+	float *wx = river + ncol; /* 4 weights per pixel */
+	float *nx = wx + 4 * n;
+	float *ny = nx + n;
+	float *detail = ny + n;
+	int *tap = malloc(n * sizeof(int)); /* first column of every pixel */
+
+	for (int i = 0; i < n; i++) {
+		const float u = overview_coord(x0 + i, job->scale);
+		const float fu = floorf(u);
+		tap[i] = (int)fu - 1 - c0;
+		cubic_weights(u - fu, &wx[4*i]);
+		nx[i] = (x0 + i) * job->scale;
+	}
+
+	const unsigned char *lland = ov->layer[LAYER_LAND];
+	const unsigned char *lriver = ov->layer[LAYER_RIVER];
+	for (int y = job->y0; y < job->y1; y++) {
+		const float v = overview_coord(y, job->scale);
+		const float fv = floorf(v);
+		float wy[4];
+		size_t rows[4];
+		cubic_weights(v - fv, wy);
+		for (int k = 0; k < 4; k++) {
+			rows[k] = (size_t)min(max((int)fv - 1 + k, 0), ores - 1) * ores;
+		}
+		for (int c = 0; c < ncol; c++) {
+			const int oc = min(max(c0 + c, 0), ores - 1);
+			float h = 0.f, l = 0.f, r = 0.f;
+			for (int k = 0; k < 4; k++) {
+				h += wy[k] * ov->height[rows[k] + oc];
+				l += wy[k] * lland[rows[k] + oc];
+				r += wy[k] * lriver[rows[k] + oc];
+			}
+			height[c] = h;
+			land[c] = l;
+			river[c] = r;
+		}
+
+		const float py = y * job->scale;
+		for (int i = 0; i < n; i++) {
+			ny[i] = py;
+		}
+		fbm_noise_batch(detail, nx, ny, n, 0.5f, 2.5f, 2.0f, job->seed);
+
+		unsigned short *out = &job->band[(size_t)(y - job->y0) * job->res + x0];
+		for (int i = 0; i < n; i++) {
+			const float *w = &wx[4*i];
+			const int t = tap[i];
+			float h = 0.f, l = 0.f, r = 0.f;
+			for (int k = 0; k < 4; k++) {
+				h += w[k] * height[t+k];
+				l += w[k] * land[t+k];
+				r += w[k] * river[t+k];
+			}
+			/* bumps on the land below the resolution of the overview,
+			 * flat in the river beds */
+			const float mask = min(max(l / LAYER_LAND_MAX, 0.f), 1.f) * min(max(r / 255.f, 0.f), 1.f);
+			h += TILED_DETAIL * 65535.f * detail[i] * mask;
+			out[i] = min(max(h, 0.f), 65535.f) + 0.5f;
+		}
+	}
+
+	free(tap);
+	free(scratch);
+	trace_end();
+}
+
+int tiled_bake(const struct world *overview, int resolution, int tile, tiled_writer write, void *ctx, struct pool *pool, struct tiled_stats *stats)
+{
+	const struct rng root = rng_seed(overview->params.seed);
+	struct rng detail_rng = rng_split(&root, TILED_STREAM);
+	struct tile_job job = {
+		.overview = overview,
+		.res = resolution,
+		.tile = tile,
+		.scale = (double)overview->resolution / resolution,
+		.seed = rng_next(&detail_rng) & 0xffff,
+	};
+
+	stats->band_bytes = (size_t)resolution * tile * sizeof(unsigned short);
+	stats->tiles_ms = 0.0;
+	stats->write_ms = 0.0;
+	job.band = malloc(stats->band_bytes);
+	trace_alloc(stats->band_bytes);
+
+	int ok = 1;
+	const int ntile = (resolution + tile - 1) / tile;
+	for (job.y0 = 0; job.y0 < resolution && ok; job.y0 += tile) {
+		job.y1 = min(job.y0 + tile, resolution);
+
+		double mark = trace_now_ms();
+		trace_begin("band");
+		pool_run(pool, ntile, bake_tile, &job);
+		trace_end();
+		stats->tiles_ms += trace_now_ms() - mark;
+
+		mark = trace_now_ms();
+		trace_begin("write");
+		ok = write(ctx, job.band, job.y0, job.y1 - job.y0);
+		trace_end();
+		stats->write_ms += trace_now_ms() - mark;
+	}
+
+	free(job.band);
+
+	return ok;
+}
@@ -0,0 +1,30 @@
+/* out-of-core generation of heightmaps larger than memory
+ * the world is generated whole at the overview resolution, or loaded from
+ * the cache, which settles everything that is not local: the coasts, the cells and
+ * ranges, the drainage and the rivers, every pixel of the full heightmap is
+ * then a function of its position and the overview alone, bicubic heights
+ * plus fbm detail on the land, so tiles agree along every border whatever
+ * their size, bands of tiles run over the pool and each band is handed to
+ * the writer before the next one starts, memory holds the overview and one
+ * band */
+
+#define TILED_TILE 256 /* default pixels along each side of a tile */
+#define TILED_DETAIL 0.02f /* amplitude of the detail noise, of the full height range */
+
+struct pool;
+struct world;
+
+struct tiled_stats {
+	double tiles_ms; /* computing the bands */
+	double write_ms; /* in the writer */
+	size_t band_bytes;
+};
+
+/* receives rows y to y + nrows of the heightmap in order, returns 0 to
+ * stop the bake */
+typedef int (*tiled_writer)(void *ctx, const unsigned short *rows, int y, int nrows);
+
+/* bakes a resolution x resolution heightmap, at least the resolution of
+ * the overview, in tiles of tile pixels, the overview needs its layers so
+ * it is a generated or cached world, returns 0 when the writer failed */
+int tiled_bake(const struct world *overview, int resolution, int tile, tiled_writer write, void *ctx, struct pool *pool, struct tiled_stats *stats);
@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+
+#define TRACE_MAX_DEPTH 32
+
+struct event {
+	const char *name;
+	char phase; /* 'B' begin, 'E' end, 'M' thread name */
+	int tid;
+	double ts; /* microseconds since trace_start() */
+	size_t bytes; /* end events only, allocated inside the scope */
+};
+
+static struct {
+	int enabled;
+	char *path;
+	double start;
+	pthread_mutex_t lock;
+	struct event *events;
+	size_t nevents;
+	size_t capacity;
+	int nthreads;
+	int epoch; /* bumped by trace_start() so every lane is named once per trace */
+} trace = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* lane of the calling thread, 0 until its first event */
+static __thread int thread_id;
+static __thread int thread_epoch;
+static __thread char thread_label[32];
+static __thread int depth;
+static __thread size_t scope_bytes[TRACE_MAX_DEPTH];
+
+double trace_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static double now_us(void)
+{
+	return trace_now_ms() * 1000.0;
+}
+
+static int enabled(void)
+{
+	return __atomic_load_n(&trace.enabled, __ATOMIC_ACQUIRE);
+}
+
+/* call with the lock held */
+static int lane(void)
+{
+	if (thread_id == 0) {
+		thread_id = ++trace.nthreads;
+	}
+
+	return thread_id;
+}
+
+/* call with the lock held */
+static struct event *new_event(void)
+{
+	if (trace.nevents == trace.capacity) {
+		trace.capacity = trace.capacity ? 2 * trace.capacity : 1024;
+		trace.events = realloc(trace.events, trace.capacity * sizeof(struct event));
+	}
+
+	return &trace.events[trace.nevents++];
+}
+
+static void push_event(const char *name, char phase, size_t bytes)
+{
+	const double ts = now_us();
+
+	pthread_mutex_lock(&trace.lock);
+	if (thread_epoch != trace.epoch) {
+		/* first event of this thread in the trace, name its lane */
+		thread_epoch = trace.epoch;
+		struct event *m = new_event();
+		m->name = strdup(thread_label[0] ? thread_label : "thread");
+		m->phase = 'M';
+		m->tid = lane();
+		m->ts = 0.0;
+		m->bytes = 0;
+	}
+	struct event *e = new_event();
+	e->name = name;
+	e->phase = phase;
+	e->tid = lane();
+	e->ts = ts - trace.start;
+	e->bytes = bytes;
+	pthread_mutex_unlock(&trace.lock);
+}
+
+void trace_start(const char *path)
+{
+	pthread_mutex_lock(&trace.lock);
+	free(trace.path);
+	trace.path = strdup(path);
+	trace.start = now_us();
+	trace.nevents = 0;
+	trace.epoch++;
+	pthread_mutex_unlock(&trace.lock);
+
+	if (thread_label[0] == '\0') {
+		trace_thread_name("main");
+	}
+	__atomic_store_n(&trace.enabled, 1, __ATOMIC_RELEASE);
+}
+
+void trace_begin(const char *name)
+{
+	if (!enabled()) {
+		return;
+	}
+
+	if (depth < TRACE_MAX_DEPTH) {
+		scope_bytes[depth] = 0;
+	}
+	depth++;
+	push_event(name, 'B', 0);
+}
+
+void trace_end(void)
+{
+	if (!enabled() || depth == 0) {
+		return;
+	}
+
+	depth--;
+	size_t bytes = 0;
+	if (depth < TRACE_MAX_DEPTH) {
+		bytes = scope_bytes[depth];
+		if (depth > 0 && depth - 1 < TRACE_MAX_DEPTH) {
+			scope_bytes[depth-1] += bytes;
+		}
+	}
+	push_event(NULL, 'E', bytes);
+}
+
+void trace_alloc(size_t bytes)
+{
+	if (enabled() && depth > 0 && depth <= TRACE_MAX_DEPTH) {
+		scope_bytes[depth-1] += bytes;
+	}
+}
+
+void trace_thread_name(const char *name)
+{
+	snprintf(thread_label, sizeof(thread_label), "%s", name);
+}
+
+static void write_string(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			fputc('\\', fp);
+		}
+		fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+int trace_stop(void)
+{
+	if (!enabled()) {
+		return 1;
+	}
+	__atomic_store_n(&trace.enabled, 0, __ATOMIC_RELEASE);
+
+	pthread_mutex_lock(&trace.lock);
+	FILE *fp = fopen(trace.path, "w");
+	if (fp == NULL) {
+		perror(trace.path);
+	} else {
+		fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		for (size_t i = 0; i < trace.nevents; i++) {
+			const struct event *e = &trace.events[i];
+			fprintf(fp, "{\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", e->phase, e->tid, e->ts);
+			if (e->phase == 'B') {
+				fprintf(fp, ",\"name\":");
+				write_string(fp, e->name);
+			} else if (e->phase == 'E') {
+				fprintf(fp, ",\"args\":{\"bytes\":%zu}", e->bytes);
+			} else {
+				fprintf(fp, ",\"name\":\"thread_name\",\"args\":{\"name\":");
+				write_string(fp, e->name);
+				fputc('}', fp);
+			}
+			fprintf(fp, "}%s\n", i + 1 < trace.nevents ? "," : "");
+		}
+		fprintf(fp, "]}\n");
+	}
+
+	int ok = fp != NULL && !ferror(fp);
+	if (fp && fclose(fp) != 0) {
+		ok = 0;
+	}
+
+	for (size_t i = 0; i < trace.nevents; i++) {
+		if (trace.events[i].phase == 'M') {
+			free((char *)trace.events[i].name);
+		}
+	}
+	free(trace.events);
+	trace.events = NULL;
+	trace.nevents = trace.capacity = 0;
+	pthread_mutex_unlock(&trace.lock);
+
+	return ok;
+}
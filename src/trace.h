@@ -0,0 +1,24 @@
+/* chrome trace of the generation path, open the file in chrome://tracing
+ * or ui.perfetto.dev, every call is a no-op until trace_start() */
+
+/* records events until trace_stop() writes them to path */
+void trace_start(const char *path);
+
+/* writes the trace, returns 0 on failure */
+int trace_stop(void);
+
+/* opens a scope on the calling thread, the name must outlive the trace */
+void trace_begin(const char *name);
+
+/* closes the innermost scope of the calling thread */
+void trace_end(void);
+
+/* counts bytes against the innermost scope, scopes include their children */
+void trace_alloc(size_t bytes);
+
+/* labels the lane of the calling thread, may be called before trace_start() */
+void trace_thread_name(const char *name);
+
+/* monotonic clock in milliseconds, the one the trace timestamps come from,
+ * for timing outside of a trace too */
+double trace_now_ms(void);
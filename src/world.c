@@ -0,0 +1,1061 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include "gmath.h"
+#include "arena.h"
+#include "bitmask.h"
+#include "edt.h"
+#include "erode.h"
+#include "hydro.h"
+#include "noise.h"
+#include "pool.h"
+#include "poisson.h"
+#include "quadtree.h"
+#include "rng.h"
+#include "trace.h"
+#include "voronoi.h"
+#include "cellmap.h"
+#include "world.h"
+
+/* values of the land mask */
+enum {
+	WATER = 0,
+	LAND = LAYER_LAND_MAX,
+};
+
+enum celltype {
+	COASTAL,
+	INLAND,
+	MOUNTAIN,
+};
+
+/* buffers passed between the stages, the layers and heights live in
+ * struct world and everything else in struct world_state */
+enum world_buffer {
+	BUF_ELEVATION, /* LAYER_ELEVATION */
+	BUF_THRESHOLD, /* land mask straight from the noise */
+	BUF_LAKES, /* threshold with the small lakes filled */
+	BUF_MASK, /* lakes with the small islands flooded */
+	BUF_SITES,
+	BUF_DIAGRAM,
+	BUF_CELLMAP, /* cell index of every pixel */
+	BUF_CELLS, /* cells classified into coastal and inland */
+	BUF_RANGE, /* mountain cells, raster and celltype */
+	BUF_DISTANCE, /* signed distances to the coast and the ranges */
+	BUF_LAND, /* LAYER_LAND */
+	BUF_MOUNTAIN, /* LAYER_MOUNTAIN */
+	BUF_RELIEF, /* heights before the rivers are carved in */
+	BUF_ERODED, /* relief worn down by the droplets */
+	BUF_FLOW, /* flow directions and accumulation */
+	BUF_RIVER, /* LAYER_RIVER */
+	BUF_HEIGHT,
+	BUF_BOUNDS, /* world->bounds */
+	BUF_NORMAL, /* world->normal */
+	BUF_SPLAT, /* world->splat */
+};
+
+#define BUF(b) (1u << (b))
+
+/* intermediate results kept so world_update() can resume mid-pipeline */
+struct world_state {
+	int valid; /* every stage has run at least once */
+	int aliased; /* planes share memory once dead, every update reruns every stage */
+	struct arena *arena; /* the planes and the scratch of the running stage */
+	size_t mark; /* end of the planes, the scratch is released back to it */
+	char *stage_scratch[STAGE_COUNT]; /* planned scratch of every stage */
+	char *scratch; /* the one of the running stage */
+	size_t scratch_size;
+	size_t scratch_used;
+	uint64_t key[STAGE_COUNT]; /* hash of the parameters each stage last ran with */
+	unsigned char *threshold;
+	unsigned char *lakes;
+	unsigned char *mask;
+	int nsite;
+	jcv_point *site;
+	jcv_diagram diagram;
+	int *cellid; /* pixels of st->cells */
+	struct cellmap cells;
+	enum celltype *coast; /* COASTAL or INLAND for every cell */
+	enum celltype *celltype; /* coast with the mountains raised */
+	unsigned char *range; /* 255 on the mountain cells */
+	float *coastdist; /* signed distance to the coast, positive on land */
+	float *rangedist; /* signed distance to the ranges, positive on them */
+	unsigned short *relief;
+	unsigned short *eroded;
+	unsigned char *flowdir; /* D8 direction of every pixel, see hydro.h */
+	float *accum; /* pixels draining through every pixel */
+};
+
+struct stage {
+	const char *name;
+	unsigned inputs; /* BUF() masks */
+	unsigned outputs;
+	void (*run)(struct world *world, struct pool *pool);
+	int scratch; /* bytes per pixel the stage takes from stage_alloc() */
+};
+
+/* the pixel planes, they live from the stage that writes their buffer to
+ * the last stage that reads it, or to the end for the planes of the world */
+enum world_plane {
+	PLANE_HEIGHT,
+	PLANE_NORMAL,
+	PLANE_SPLAT,
+	PLANE_ELEVATION,
+	PLANE_LAND,
+	PLANE_MOUNTAIN,
+	PLANE_RIVER,
+	PLANE_THRESHOLD,
+	PLANE_LAKES,
+	PLANE_MASK,
+	PLANE_CELLID,
+	PLANE_RANGE,
+	PLANE_COASTDIST,
+	PLANE_RANGEDIST,
+	PLANE_RELIEF,
+	PLANE_ERODED,
+	PLANE_FLOWDIR,
+	PLANE_ACCUM,
+	PLANE_COUNT
+};
+
+struct plane {
+	enum world_buffer buffer;
+	int bytes; /* per pixel */
+	int kept; /* part of the finished world */
+};
+
+static const struct plane planes[PLANE_COUNT] = {
+	[PLANE_HEIGHT] = {BUF_HEIGHT, sizeof(unsigned short), 1},
+	[PLANE_NORMAL] = {BUF_NORMAL, 2 * sizeof(short), 1},
+	[PLANE_SPLAT] = {BUF_SPLAT, SPLAT_COUNT, 1},
+	[PLANE_ELEVATION] = {BUF_ELEVATION, 1, 1},
+	[PLANE_LAND] = {BUF_LAND, 1, 1},
+	[PLANE_MOUNTAIN] = {BUF_MOUNTAIN, 1, 1},
+	[PLANE_RIVER] = {BUF_RIVER, 1, 1},
+	[PLANE_THRESHOLD] = {BUF_THRESHOLD, 1, 0},
+	[PLANE_LAKES] = {BUF_LAKES, 1, 0},
+	[PLANE_MASK] = {BUF_MASK, 1, 0},
+	[PLANE_CELLID] = {BUF_CELLMAP, sizeof(int), 0},
+	[PLANE_RANGE] = {BUF_RANGE, 1, 0},
+	[PLANE_COASTDIST] = {BUF_DISTANCE, sizeof(float), 0},
+	[PLANE_RANGEDIST] = {BUF_DISTANCE, sizeof(float), 0},
+	[PLANE_RELIEF] = {BUF_RELIEF, sizeof(unsigned short), 0},
+	[PLANE_ERODED] = {BUF_ERODED, sizeof(unsigned short), 0},
+	[PLANE_FLOWDIR] = {BUF_FLOW, 1, 0},
+	[PLANE_ACCUM] = {BUF_FLOW, sizeof(float), 0},
+};
+
+/* which parameters each stage reads, changing one reruns that stage and
+ * every stage downstream of its outputs */
+struct param_use {
+	size_t offset;
+	size_t size;
+	enum world_stage stage;
+};
+
+#define PARAM_USE(field, stage) { offsetof(struct world_params, field), sizeof(((struct world_params *)0)->field), stage }
+
+static const struct param_use param_uses[] = {
+	PARAM_USE(seed, STAGE_NOISE),
+	PARAM_USE(land_threshold, STAGE_NOISE),
+	PARAM_USE(min_lake_size, STAGE_LAKES),
+	PARAM_USE(min_island_size, STAGE_ISLANDS),
+	PARAM_USE(seed, STAGE_SITES),
+	PARAM_USE(site_spacing, STAGE_SITES),
+	PARAM_USE(mountain_threshold, STAGE_MOUNTAINS),
+	PARAM_USE(seed, STAGE_RELIEF),
+	PARAM_USE(coast_blur, STAGE_RELIEF),
+	PARAM_USE(mountain_blur, STAGE_RELIEF),
+	PARAM_USE(seed, STAGE_EROSION),
+	PARAM_USE(erosion_droplets, STAGE_EROSION),
+	PARAM_USE(flow_dinf, STAGE_FLOW),
+	PARAM_USE(river_area, STAGE_RIVERS),
+	PARAM_USE(river_width, STAGE_RIVERS),
+	PARAM_USE(river_blur, STAGE_RIVERS),
+};
+
+#define RELIEF_TILE_ROWS 8
+#define NORMAL_TILE_ROWS 16
+
+/* inputs of the relief pass, all planes are row-major width * height */
+struct relief_job {
+	int width;
+	int height;
+	const float *coastdist;
+	const float *rangedist;
+	float coast_sigma;
+	float range_sigma;
+	float offset[4]; /* seeded shift of the mountain and ridge worley cells */
+	unsigned char *land; /* LAYER_LAND */
+	unsigned char *range; /* LAYER_MOUNTAIN */
+	unsigned short *out;
+};
+
+struct normal_job {
+	int res;
+	const unsigned short *height;
+	short *normal;
+	unsigned char *splat;
+};
+
+/* pixel under a point of the diagram, which spans (0, 0) to (res, res) */
+static inline int pixel_index(vec2 p, int res)
+{
+	const int x = min(max((int)p.x, 0), res - 1);
+	const int y = min(max((int)p.y, 0), res - 1);
+
+	return y * res + x;
+}
+
+/* a binary mask blurred with a gaussian of the given sigma is, at signed
+ * distance d from a straight edge, the normal cdf of d / sigma */
+static inline float falloff(float d, float sigma)
+{
+	if (d > 4.f * sigma) {
+		return 1.f;
+	}
+	if (d < -4.f * sigma) {
+		return 0.f;
+	}
+
+	return 0.5f * erfcf(-d / (sigma * (float)M_SQRT2));
+}
+
+/* combines land, mountains and ridges in one pass, the worley rows are
+ * evaluated inline so no noise plane is stored */
+static void relief_tile(void *arg, int tile)
+{
+	const struct relief_job *job = arg;
+	const int width = job->width;
+	const int y0 = tile * RELIEF_TILE_ROWS;
+	const int y1 = min(y0 + RELIEF_TILE_ROWS, job->height);
+	const float inv = 1.f / 255.f;
+
+	trace_begin("relief tile");
+	float *scratch = malloc(6 * width * sizeof(float));
+	trace_alloc(6 * width * sizeof(float));
+	float *mx = scratch;
+	float *rx = mx + width;
+	float *my = rx + width;
+	float *ry = my + width;
+	float *mountains = ry + width;
+	float *ridges = mountains + width;
+	for (int x = 0; x < width; x++) {
+		mx[x] = 0.02 * x + job->offset[0];
+		rx[x] = 0.03 * x + job->offset[2];
+	}
+
+	for (int y = y0; y < y1; y++) {
+		const float mrow = 0.030 * y + job->offset[1];
+		const float rrow = 0.02 * y + job->offset[3];
+		for (int x = 0; x < width; x++) {
+			my[x] = mrow;
+			ry[x] = rrow;
+		}
+		worley_noise_batch(mountains, mx, my, width);
+		worley_noise_batch(ridges, rx, ry, width);
+
+		const size_t row = (size_t)y * width;
+		for (int x = 0; x < width; x++) {
+			const float land = falloff(job->coastdist[row+x], job->coast_sigma);
+			const float range = falloff(job->rangedist[row+x], job->range_sigma);
+			job->land[row+x] = land * LAND + 0.5f;
+			job->range[row+x] = range * 255.f + 0.5f;
+
+			const float peaks = (1.f - sqrtf(mountains[x])) * range * 0.6f;
+			const float ridge = ridges[x] * range * 0.6f;
+			float h = land * (LAND * inv) + 0.5f * (peaks + ridge);
+			h = clamp(h, 0.f, 1.f);
+			job->out[row+x] = h * 65535.f + 0.5f;
+		}
+	}
+
+	free(scratch);
+	trace_end();
+}
+
+/* central differences as the terrain shader took them per fragment,
+ * with the heights in [0, 1] and a texel 64 / res wide, y is left out since
+ * it is never negative */
+static void normal_tile(void *arg, int tile)
+{
+	const struct normal_job *job = arg;
+	const int res = job->res;
+	const int y0 = tile * NORMAL_TILE_ROWS;
+	const int y1 = min(y0 + NORMAL_TILE_ROWS, res);
+	const float delta = 64.f / res;
+	const float inv = 1.f / 65535.f;
+
+	for (int y = y0; y < y1; y++) {
+		const unsigned short *row = &job->height[(size_t)y * res];
+		const unsigned short *down = &job->height[(size_t)max(y - 1, 0) * res];
+		const unsigned short *up = &job->height[(size_t)min(y + 1, res - 1) * res];
+		short *out = &job->normal[2 * (size_t)y * res];
+		for (int x = 0; x < res; x++) {
+			const float dx = (row[min(x + 1, res - 1)] - row[max(x - 1, 0)]) * inv;
+			const float dz = (up[x] - down[x]) * inv;
+			const float scale = 32767.f / sqrtf(dx * dx + dz * dz + delta * delta);
+			out[2*x] = lrintf(-dx * scale);
+			out[2*x+1] = lrintf(-dz * scale);
+		}
+	}
+}
+
+/* smoothstep(lo, lo + 1 / inv, x) without the call and the division */
+static inline float ramp(float lo, float inv, float x)
+{
+	const float t = min(max((x - lo) * inv, 0.f), 1.f);
+
+	return t * t * (3.f - 2.f * t);
+}
+
+/* the material selection the terrain shader made per fragment, from the
+ * height in [0, 1] and the slope 1 - n.y of the baked normals:
+ * gravel below the beaches, grass turning to snow higher up and stone on
+ * the steep slopes over all of them */
+static void splat_tile(void *arg, int tile)
+{
+	const struct normal_job *job = arg;
+	const int res = job->res;
+	const int y0 = tile * NORMAL_TILE_ROWS;
+	const int y1 = min(y0 + NORMAL_TILE_ROWS, res);
+
+	for (size_t i = (size_t)y0 * res; i < (size_t)y1 * res; i++) {
+		const float h = job->height[i] / 65535.f;
+		const float nx = job->normal[2*i] / 32767.f;
+		const float nz = job->normal[2*i+1] / 32767.f;
+		const float slope = 1.f - sqrtf(max(1.f - nx * nx - nz * nz, 0.f));
+
+		const float high = ramp(0.4f, 1.f / 0.2f, h);
+		const float shore = ramp(0.12f, 1.f / 0.03f, h);
+		const float steep = ramp(0.1f, 1.f / 0.6f, slope);
+		const int grass = shore * (1.f - high) * (1.f - steep) * 255.f + 0.5f;
+		const int gravel = (1.f - shore) * (1.f - steep) * 255.f + 0.5f;
+		const int snow = shore * high * (1.f - steep) * 255.f + 0.5f;
+
+		/* the weights sum to one, stone takes the rounding of the others */
+		unsigned char *out = &job->splat[4*i];
+		out[SPLAT_GRASS] = grass;
+		out[SPLAT_GRAVEL] = gravel;
+		out[SPLAT_SNOW] = snow;
+		out[SPLAT_STONE] = max(255 - grass - gravel - snow, 0);
+	}
+}
+
+void world_default_params(struct world_params *params, uint64_t seed, int resolution)
+{
+	params->seed = seed;
+	params->resolution = resolution;
+	params->land_threshold = 0.55;
+	params->min_lake_size = resolution * 2;
+	params->min_island_size = resolution;
+	params->coast_blur = 5.0;
+	params->site_spacing = resolution / 40.0;
+	params->mountain_threshold = 0.7;
+	params->mountain_blur = 10.0;
+	params->river_area = resolution * resolution / 2048;
+	params->river_width = 8.0;
+	params->river_blur = 5.0;
+	params->erosion_droplets = (long)resolution * resolution / 8;
+	params->flow_dinf = 0;
+}
+
+/* FNV-1a over the parameters one field at a time, so struct padding never
+ * ends up in the hash */
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	for (size_t i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+#define HASH_FIELD(h, field) hash_bytes((h), &(field), sizeof(field))
+
+uint64_t world_params_hash(const struct world_params *params)
+{
+	const uint32_t version = WORLD_VERSION;
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	h = HASH_FIELD(h, version);
+	h = HASH_FIELD(h, params->seed);
+	h = HASH_FIELD(h, params->resolution);
+	h = HASH_FIELD(h, params->land_threshold);
+	h = HASH_FIELD(h, params->min_lake_size);
+	h = HASH_FIELD(h, params->min_island_size);
+	h = HASH_FIELD(h, params->coast_blur);
+	h = HASH_FIELD(h, params->site_spacing);
+	h = HASH_FIELD(h, params->mountain_threshold);
+	h = HASH_FIELD(h, params->mountain_blur);
+	h = HASH_FIELD(h, params->river_area);
+	h = HASH_FIELD(h, params->river_width);
+	h = HASH_FIELD(h, params->river_blur);
+	h = HASH_FIELD(h, params->erosion_droplets);
+	h = HASH_FIELD(h, params->flow_dinf);
+
+	return h;
+}
+
+/* every stage draws from its own stream so stages do not shift each other */
+static struct rng stage_rng(const struct world *world, enum world_stage stage)
+{
+	const struct rng root = rng_seed(world->params.seed);
+
+	return rng_split(&root, stage);
+}
+
+/* scratch of the running stage, released when it returns, what does not fit
+ * the planned scratch comes from the end of the arena */
+static void *stage_alloc(struct world *world, size_t size)
+{
+	struct world_state *st = world->state;
+	const size_t start = (st->scratch_used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	trace_alloc(size);
+	if (start + size <= st->scratch_size) {
+		st->scratch_used = start + size;
+		return st->scratch + start;
+	}
+
+	return arena_alloc(st->arena, size);
+}
+
+/* lets the trace see what the voronoi diagram allocates */
+static void *counted_alloc(void *ctx, size_t size)
+{
+	trace_alloc(size);
+	return malloc(size);
+}
+
+static void counted_free(void *ctx, void *p)
+{
+	free(p);
+}
+
+static void stage_noise(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+	const int res = world->resolution;
+	const size_t size = (size_t)res * res;
+	unsigned char *perlin = world->layer[LAYER_ELEVATION];
+
+	float *field = stage_alloc(world, size * sizeof(float));
+	struct rng noise_rng = stage_rng(world, STAGE_NOISE);
+	fbm_field(field, res, res, 0.5, 0.005, 2.5, 2.0, rng_next(&noise_rng) & 0xffff, pool);
+	for (size_t i = 0; i < size; i++) {
+		perlin[i] = field[i] * 255.0;
+		st->threshold[i] = field[i] > world->params.land_threshold ? LAND : WATER;
+	}
+}
+
+/* recolors the components of src smaller than limit that have the given
+ * value, src only holds value and fill */
+static void remove_small(struct world *world, const unsigned char *src, unsigned char *dst, unsigned char value, unsigned char fill, int limit)
+{
+	const int res = world->resolution;
+	struct bitmask mask = bitmask_wrap(stage_alloc(world, bitmask_bytes(res, res)), res, res);
+
+	bitmask_pack(&mask, src, value);
+	bitmask_clear_components(&mask, 2, limit);
+	bitmask_unpack(dst, &mask, value, fill);
+}
+
+static void stage_lakes(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+	remove_small(world, st->threshold, st->lakes, WATER, LAND, world->params.min_lake_size);
+}
+
+/* filled lakes may have joined some of the islands */
+static void stage_islands(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+	remove_small(world, st->lakes, st->mask, LAND, WATER, world->params.min_island_size);
+}
+
+static void stage_sites(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+	const int res = world->resolution;
+
+	const float spacing = world->params.site_spacing;
+
+	/* blue noise on the land only, dense enough for any spacing and it
+	 * terminates on a world without land */
+	const int capacity = poisson_capacity(res, res, spacing);
+	vec2 *point = stage_alloc(world, capacity * sizeof(vec2));
+	struct rng site_rng = stage_rng(world, STAGE_SITES);
+	st->nsite = poisson_disc(point, st->mask, res, res, LAND, spacing, &site_rng);
+
+	st->site = realloc(st->site, max(st->nsite, 1) * sizeof(jcv_point));
+	for (int i = 0; i < st->nsite; i++) {
+		st->site[i].x = point[i].x;
+		st->site[i].y = point[i].y;
+	}
+}
+
+static void stage_voronoi(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+
+	if (st->diagram.internal) {
+		jcv_diagram_free(&st->diagram);
+	}
+	memset(&st->diagram, 0, sizeof(jcv_diagram));
+	if (st->nsite == 0) {
+		return;
+	}
+
+	/* the cells cover the whole image, so diagram and pixel coordinates match */
+	const jcv_rect rect = {{0.f, 0.f}, {world->resolution, world->resolution}};
+	trace_begin("jcv_diagram_generate");
+	jcv_diagram_generate_useralloc(st->nsite, st->site, &rect, 0, NULL, counted_alloc, counted_free, &st->diagram);
+	trace_end();
+}
+
+/* rasterizes the diagram once, the later stages look cells up per pixel
+ * and walk the pixels of a cell as row spans */
+static void stage_cells(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+
+	cellmap_free(&st->cells);
+	cellmap_build(&st->cells, st->cellid, &st->diagram, world->resolution, world->resolution, pool);
+}
+
+/* find the coastal cells, the ones with water on any of their pixels */
+static void stage_coast(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+	const int res = world->resolution;
+	const struct cellmap *cells = &st->cells;
+	struct bitmask water = bitmask_wrap(stage_alloc(world, bitmask_bytes(res, res)), res, res);
+	bitmask_pack(&water, st->mask, WATER);
+
+	st->coast = realloc(st->coast, max(cells->ncell, 1) * sizeof(enum celltype));
+	trace_alloc(cells->ncell * sizeof(enum celltype));
+	for (int i = 0; i < cells->ncell; i++) {
+		st->coast[i] = INLAND;
+
+		const struct cell_info *info = &cells->cell[i];
+		for (int j = 0; j < info->nspan && st->coast[i] == INLAND; j++) {
+			const struct cell_span *s = &cells->span[info->span + j];
+			if (bitmask_count_span(&water, s->y, s->x0, s->x1)) {
+				st->coast[i] = COASTAL;
+			}
+		}
+	}
+}
+
+static void stage_mountains(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+	const int res = world->resolution;
+	const struct cellmap *cells = &st->cells;
+	const jcv_site *sites = cells->ncell ? jcv_diagram_get_sites(&st->diagram) : NULL;
+	const unsigned char *perlin = world->layer[LAYER_ELEVATION];
+	unsigned char *mountainr = st->range;
+	unsigned char red = 255.0;
+
+	trace_begin("mountain raster");
+	memset(mountainr, 0, (size_t)res * res);
+	st->celltype = realloc(st->celltype, max(cells->ncell, 1) * sizeof(enum celltype));
+	trace_alloc(cells->ncell * sizeof(enum celltype));
+	for (int i = 0; i < cells->ncell; i++) {
+		const vec2 center = {{sites[i].p.x, sites[i].p.y}};
+		const float hsample = perlin[pixel_index(center, res)]/255.f;
+		st->celltype[i] = st->coast[i];
+		if (hsample > world->params.mountain_threshold && st->coast[i] == INLAND) {
+			st->celltype[i] = MOUNTAIN;
+			const struct cell_info *info = &cells->cell[i];
+			for (int j = 0; j < info->nspan; j++) {
+				const struct cell_span *s = &cells->span[info->span + j];
+				memset(&mountainr[(size_t)s->y * res + s->x0], red, s->x1 - s->x0);
+			}
+		}
+	}
+
+	trace_end();
+}
+
+/* the falloffs of the coast and the ranges are functions of these, so any
+ * width costs the same */
+static void stage_distance(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+	const int res = world->resolution;
+
+	float *scratch = stage_alloc(world, (size_t)res * res * sizeof(float));
+	trace_begin("coast edt");
+	edt_signed(st->coastdist, scratch, st->mask, LAND, res, res, pool);
+	trace_end();
+	trace_begin("range edt");
+	edt_signed(st->rangedist, scratch, st->range, 255, res, res, pool);
+	trace_end();
+}
+
+/* land, mountains and ridges without the rivers, the terrain the water
+ * runs over */
+static void stage_relief(struct world *world, struct pool *pool)
+{
+	const struct world_state *st = world->state;
+	const int res = world->resolution;
+	struct relief_job job = {
+		.width = res,
+		.height = res,
+		.coastdist = st->coastdist,
+		.rangedist = st->rangedist,
+		.coast_sigma = world->params.coast_blur,
+		.range_sigma = world->params.mountain_blur,
+		.land = world->layer[LAYER_LAND],
+		.range = world->layer[LAYER_MOUNTAIN],
+		.out = st->relief,
+	};
+	/* worley noise repeats every 289 cells */
+	struct rng relief_rng = stage_rng(world, STAGE_RELIEF);
+	for (int i = 0; i < 4; i++) {
+		job.offset[i] = rng_int(&relief_rng, 289);
+	}
+	pool_run(pool, (res + RELIEF_TILE_ROWS - 1) / RELIEF_TILE_ROWS, relief_tile, &job);
+}
+
+/* droplet erosion on a float copy, heights are scaled to pixels so slopes
+ * match the rendered terrain, which is 16 times wider than it is high */
+static void stage_erosion(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+	const int res = world->resolution;
+	const size_t size = (size_t)res * res;
+
+	if (world->params.erosion_droplets <= 0) {
+		memcpy(st->eroded, st->relief, size * sizeof(unsigned short));
+		return;
+	}
+
+	const float scale = res / 16.f / 65535.f;
+	float *elevation = stage_alloc(world, size * sizeof(float));
+	for (size_t i = 0; i < size; i++) {
+		elevation[i] = st->relief[i] * scale;
+	}
+
+	trace_begin("droplets");
+	struct rng erosion_rng = stage_rng(world, STAGE_EROSION);
+	erode_droplets(elevation, res, res, world->params.erosion_droplets, &erosion_rng, pool);
+	trace_end();
+
+	for (size_t i = 0; i < size; i++) {
+		st->eroded[i] = clamp(elevation[i] / scale, 0.f, 65535.f) + 0.5f;
+	}
+}
+
+/* fills the depressions of the relief and accumulates the flow, everything
+ * drains into the sea, the lakes that survived and over the map border,
+ * D-infinity spreads the flow of a pixel over two neighbors, which widens
+ * the drained areas on open slopes */
+static void stage_flow(struct world *world, struct pool *pool)
+{
+	struct world_state *st = world->state;
+	const int res = world->resolution;
+	const size_t size = (size_t)res * res;
+
+	int *order = stage_alloc(world, size * sizeof(int));
+	int *next = stage_alloc(world, size * sizeof(int));
+	unsigned short *filled = stage_alloc(world, size * sizeof(unsigned short));
+	unsigned char *outlet = stage_alloc(world, size);
+	for (size_t i = 0; i < size; i++) {
+		outlet[i] = st->mask[i] == WATER;
+	}
+
+	trace_begin("priority flood");
+	hydro_flood_u16(st->eroded, outlet, res, res, filled, st->flowdir, order, next);
+	trace_end();
+	if (!world->params.flow_dinf) {
+		trace_begin("accumulate");
+		hydro_accumulate(st->flowdir, order, res, res, st->accum);
+		trace_end();
+		return;
+	}
+
+	/* the queue links are dead once the flood is done */
+	float *frac = (float *)next;
+	trace_begin("d-infinity");
+	hydro_dinf_u16(filled, res, res, st->flowdir, frac);
+	trace_end();
+	trace_begin("accumulate");
+	hydro_accumulate_dinf(st->flowdir, frac, order, res, res, st->accum);
+	trace_end();
+}
+
+/* a river runs wherever enough land drains through a pixel, it widens with
+ * the drained area up to river_width at 16 times river_area */
+static void stage_rivers(struct world *world, struct pool *pool)
+{
+	const struct world_state *st = world->state;
+	const struct world_params *params = &world->params;
+	const int res = world->resolution;
+	const size_t size = (size_t)res * res;
+	unsigned char *riverr = world->layer[LAYER_RIVER];
+	memset(riverr, 255, size);
+
+	trace_begin("river raster");
+	for (int y = 0; y < res; y++) {
+		for (int x = 0; x < res; x++) {
+			const size_t i = (size_t)y * res + x;
+			if (st->accum[i] < params->river_area || st->flowdir[i] == HYDRO_OUTLET) {
+				continue;
+			}
+			const float width = params->river_width * sqrtf(st->accum[i] / (16.f * params->river_area));
+			const float r = 0.5f * clamp(width, 1.f, params->river_width);
+			const int ir = ceilf(r - 0.5f);
+			for (int dy = -ir; dy <= ir; dy++) {
+				for (int dx = -ir; dx <= ir; dx++) {
+					const int nx = x + dx;
+					const int ny = y + dy;
+					if (nx >= 0 && ny >= 0 && nx < res && ny < res && dx * dx + dy * dy <= r * r + 0.25f) {
+						riverr[(size_t)ny * res + nx] = 0;
+					}
+				}
+			}
+		}
+	}
+	trace_end();
+
+	/* soft banks from the distance to the river beds */
+	float *dist = stage_alloc(world, 2 * size * sizeof(float));
+	edt_signed(dist, dist + size, riverr, 0, res, res, pool);
+	for (size_t i = 0; i < size; i++) {
+		riverr[i] = (1.f - falloff(dist[i], params->river_blur)) * 255.f + 0.5f;
+	}
+}
+
+/* carves the rivers into the eroded relief */
+static void stage_composite(struct world *world, struct pool *pool)
+{
+	const size_t size = (size_t)world->resolution * world->resolution;
+	const unsigned short *relief = world->state->eroded;
+	const unsigned char *river = world->layer[LAYER_RIVER];
+
+	for (size_t i = 0; i < size; i++) {
+		world->height[i] = ((unsigned)relief[i] * river[i] + 127) / 255;
+	}
+}
+
+/* culling and ray queries read height bounds from the pyramid instead of
+ * scanning the heights */
+static void stage_bounds(struct world *world, struct pool *pool)
+{
+	const int res = world->resolution;
+
+	quadtree_free(world->bounds);
+	world->bounds = quadtree_build(world->height, res, res, pool);
+	trace_alloc((size_t)res * res / 3 * 2 * sizeof(unsigned short));
+}
+
+/* baked once so the terrain shader fetches a normal instead of four heights */
+static void stage_normals(struct world *world, struct pool *pool)
+{
+	const int res = world->resolution;
+	struct normal_job job = {res, world->height, world->normal};
+
+	pool_run(pool, (res + NORMAL_TILE_ROWS - 1) / NORMAL_TILE_ROWS, normal_tile, &job);
+}
+
+/* the terrain shader samples only the materials with a weight */
+static void stage_splat(struct world *world, struct pool *pool)
+{
+	const int res = world->resolution;
+	struct normal_job job = {res, world->height, world->normal, world->splat};
+
+	pool_run(pool, (res + NORMAL_TILE_ROWS - 1) / NORMAL_TILE_ROWS, splat_tile, &job);
+}
+
+/* in pipeline order, every stage only reads buffers of the stages above it */
+static const struct stage stages[STAGE_COUNT] = {
+	[STAGE_NOISE] = {"noise", 0, BUF(BUF_ELEVATION) | BUF(BUF_THRESHOLD), stage_noise, 4},
+	[STAGE_LAKES] = {"lakes", BUF(BUF_THRESHOLD), BUF(BUF_LAKES), stage_lakes, 1},
+	[STAGE_ISLANDS] = {"islands", BUF(BUF_LAKES), BUF(BUF_MASK), stage_islands, 1},
+	[STAGE_SITES] = {"sites", BUF(BUF_MASK), BUF(BUF_SITES), stage_sites},
+	[STAGE_VORONOI] = {"voronoi", BUF(BUF_SITES), BUF(BUF_DIAGRAM), stage_voronoi},
+	[STAGE_CELLS] = {"cells", BUF(BUF_DIAGRAM), BUF(BUF_CELLMAP), stage_cells},
+	[STAGE_COAST] = {"coast", BUF(BUF_MASK) | BUF(BUF_CELLMAP), BUF(BUF_CELLS), stage_coast, 1},
+	[STAGE_MOUNTAINS] = {"mountains", BUF(BUF_ELEVATION) | BUF(BUF_CELLS) | BUF(BUF_CELLMAP), BUF(BUF_RANGE), stage_mountains},
+	[STAGE_DISTANCE] = {"distance", BUF(BUF_MASK) | BUF(BUF_RANGE), BUF(BUF_DISTANCE), stage_distance, 4},
+	[STAGE_RELIEF] = {"relief", BUF(BUF_DISTANCE), BUF(BUF_LAND) | BUF(BUF_MOUNTAIN) | BUF(BUF_RELIEF), stage_relief},
+	[STAGE_EROSION] = {"erosion", BUF(BUF_RELIEF), BUF(BUF_ERODED), stage_erosion, 4},
+	[STAGE_FLOW] = {"flow", BUF(BUF_ERODED) | BUF(BUF_MASK), BUF(BUF_FLOW), stage_flow, 11},
+	[STAGE_RIVERS] = {"rivers", BUF(BUF_FLOW), BUF(BUF_RIVER), stage_rivers, 8},
+	[STAGE_COMPOSITE] = {"composite", BUF(BUF_ERODED) | BUF(BUF_RIVER), BUF(BUF_HEIGHT), stage_composite},
+	[STAGE_BOUNDS] = {"bounds", BUF(BUF_HEIGHT), BUF(BUF_BOUNDS), stage_bounds},
+	[STAGE_NORMALS] = {"normals", BUF(BUF_HEIGHT), BUF(BUF_NORMAL), stage_normals},
+	[STAGE_SPLAT] = {"splat", BUF(BUF_HEIGHT) | BUF(BUF_NORMAL), BUF(BUF_SPLAT), stage_splat},
+};
+
+const char *world_stage_name(enum world_stage stage)
+{
+	return stages[stage].name;
+}
+
+/* hash of only the parameters the stage reads */
+static uint64_t stage_key(const struct world_params *params, enum world_stage stage)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (int i = 0; i < sizeof(param_uses) / sizeof(param_uses[0]); i++) {
+		if (param_uses[i].stage == stage) {
+			h = hash_bytes(h, (const char *)params + param_uses[i].offset, param_uses[i].size);
+		}
+	}
+
+	return h;
+}
+
+/* a block of the arena used from stage first to stage last inclusive */
+struct interval {
+	int first;
+	int last;
+	size_t size;
+	size_t offset;
+};
+
+/* room beyond the plan for scratch that does not scale with the pixels,
+ * the voronoi sites */
+#define WORLD_ARENA_SPARE (4 * ARENA_HUGE_PAGE)
+
+/* lays the planes and the stage scratch out in one block, blocks alive in
+ * the same stage never overlap, unaliased planes stay alive throughout so
+ * world_update() can resume anywhere, returns the size of the block */
+static size_t plan_layout(int resolution, int aliased, size_t plane[PLANE_COUNT], size_t scratch[STAGE_COUNT])
+{
+	const size_t size = (size_t)resolution * resolution;
+	struct interval block[PLANE_COUNT + STAGE_COUNT];
+	int order[PLANE_COUNT + STAGE_COUNT];
+	const int n = PLANE_COUNT + STAGE_COUNT;
+
+	for (int p = 0; p < PLANE_COUNT; p++) {
+		const unsigned buf = BUF(planes[p].buffer);
+		struct interval *b = &block[p];
+		b->first = 0;
+		b->last = STAGE_COUNT - 1;
+		if (aliased) {
+			while (!(stages[b->first].outputs & buf)) {
+				b->first++;
+			}
+			if (!planes[p].kept) {
+				b->last = b->first;
+				for (int i = b->first; i < STAGE_COUNT; i++) {
+					if (stages[i].inputs & buf) {
+						b->last = i;
+					}
+				}
+			}
+		}
+		b->size = size * planes[p].bytes;
+	}
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		struct interval *b = &block[PLANE_COUNT + i];
+		b->first = b->last = i;
+		b->size = size * stages[i].scratch;
+	}
+
+	/* largest first, each at the lowest offset clear of the blocks placed
+	 * before it that are alive at the same time */
+	for (int i = 0; i < n; i++) {
+		int j = i;
+		while (j > 0 && block[order[j-1]].size < block[i].size) {
+			order[j] = order[j-1];
+			j--;
+		}
+		order[j] = i;
+	}
+
+	size_t total = 0;
+	for (int i = 0; i < n; i++) {
+		struct interval *b = &block[order[i]];
+		b->size = (b->size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+		b->offset = 0;
+		int moved = 1;
+		while (moved) {
+			moved = 0;
+			for (int j = 0; j < i; j++) {
+				const struct interval *o = &block[order[j]];
+				if (o->first <= b->last && b->first <= o->last &&
+				    o->offset < b->offset + b->size && b->offset < o->offset + o->size) {
+					b->offset = o->offset + o->size;
+					moved = 1;
+				}
+			}
+		}
+		total = max(total, b->offset + b->size);
+	}
+
+	for (int p = 0; p < PLANE_COUNT; p++) {
+		plane[p] = block[p].offset;
+	}
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		scratch[i] = block[PLANE_COUNT + i].offset;
+	}
+
+	return total;
+}
+
+size_t world_plane_bytes(int resolution, int aliased)
+{
+	size_t plane[PLANE_COUNT];
+	size_t scratch[STAGE_COUNT];
+
+	return plan_layout(resolution, aliased, plane, scratch);
+}
+
+/* the planes of every stage come from one arena that a regeneration at the
+ * same or a lower resolution resets instead of mapping again */
+static void world_alloc(struct world *world, const struct world_params *params, int aliased, struct arena *arena)
+{
+	const int res = params->resolution;
+	size_t plane[PLANE_COUNT];
+	size_t scratch[STAGE_COUNT];
+	const size_t total = plan_layout(res, aliased, plane, scratch);
+	const size_t reserve = total + (size_t)res * res * sizeof(vec2) + WORLD_ARENA_SPARE;
+
+	trace_begin("alloc");
+	if (arena && arena_size(arena) < reserve) {
+		arena_destroy(arena);
+		arena = NULL;
+	}
+	if (arena) {
+		arena_reset(arena);
+	} else {
+		arena = arena_create(reserve);
+	}
+
+	trace_alloc(total);
+	char *mem = arena_alloc(arena, total);
+	memset(world, 0, sizeof(struct world));
+	world->resolution = res;
+	world->params = *params;
+	world->height = (unsigned short *)(mem + plane[PLANE_HEIGHT]);
+	world->normal = (short *)(mem + plane[PLANE_NORMAL]);
+	world->splat = (unsigned char *)(mem + plane[PLANE_SPLAT]);
+	world->layer[LAYER_ELEVATION] = (unsigned char *)(mem + plane[PLANE_ELEVATION]);
+	world->layer[LAYER_LAND] = (unsigned char *)(mem + plane[PLANE_LAND]);
+	world->layer[LAYER_MOUNTAIN] = (unsigned char *)(mem + plane[PLANE_MOUNTAIN]);
+	world->layer[LAYER_RIVER] = (unsigned char *)(mem + plane[PLANE_RIVER]);
+
+	struct world_state *st = calloc(1, sizeof(struct world_state));
+	st->threshold = (unsigned char *)(mem + plane[PLANE_THRESHOLD]);
+	st->lakes = (unsigned char *)(mem + plane[PLANE_LAKES]);
+	st->mask = (unsigned char *)(mem + plane[PLANE_MASK]);
+	st->cellid = (int *)(mem + plane[PLANE_CELLID]);
+	st->range = (unsigned char *)(mem + plane[PLANE_RANGE]);
+	st->coastdist = (float *)(mem + plane[PLANE_COASTDIST]);
+	st->rangedist = (float *)(mem + plane[PLANE_RANGEDIST]);
+	st->relief = (unsigned short *)(mem + plane[PLANE_RELIEF]);
+	st->eroded = (unsigned short *)(mem + plane[PLANE_ERODED]);
+	st->flowdir = (unsigned char *)(mem + plane[PLANE_FLOWDIR]);
+	st->accum = (float *)(mem + plane[PLANE_ACCUM]);
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		st->stage_scratch[i] = mem + scratch[i];
+	}
+	st->aliased = aliased;
+	st->arena = arena;
+	st->mark = arena_mark(arena);
+	world->state = st;
+	trace_end();
+}
+
+void world_generate(struct world *world, const struct world_params *params, struct pool *pool)
+{
+	world_alloc(world, params, 0, NULL);
+	world_update(world, params, pool);
+}
+
+void world_bake(struct world *world, const struct world_params *params, struct pool *pool)
+{
+	world_alloc(world, params, 1, NULL);
+	world_update(world, params, pool);
+}
+
+void world_update(struct world *world, const struct world_params *params, struct pool *pool)
+{
+	/* cached worlds keep no intermediates, the buffers are sized by resolution */
+	if (world->state == NULL || params->resolution != world->resolution) {
+		struct arena *arena = NULL;
+		int aliased = 0;
+		if (world->state) {
+			arena = world->state->arena;
+			aliased = world->state->aliased;
+			world->state->arena = NULL;
+		}
+		world_free(world);
+		world_alloc(world, params, aliased, arena);
+	}
+
+	struct world_state *st = world->state;
+	const size_t size = (size_t)world->resolution * world->resolution;
+	world->params = *params;
+
+	trace_begin("world_update");
+	unsigned dirty = 0; /* buffers recomputed in this update */
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		const uint64_t key = stage_key(params, i);
+		world->stage_time[i] = 0.0;
+		if (st->valid && key == st->key[i] && !(stages[i].inputs & dirty)) {
+			continue;
+		}
+
+		double mark = trace_now_ms();
+		st->scratch = st->stage_scratch[i];
+		st->scratch_size = size * stages[i].scratch;
+		st->scratch_used = 0;
+		trace_begin(stages[i].name);
+		stages[i].run(world, pool);
+		trace_end();
+		world->stage_time[i] = trace_now_ms() - mark;
+		arena_release(st->arena, st->mark);
+
+		st->key[i] = key;
+		dirty |= stages[i].outputs;
+	}
+	/* aliased intermediates were overwritten by the later stages */
+	st->valid = !st->aliased;
+	trace_end();
+}
+
+void world_free(struct world *world)
+{
+	if (world->mapping) {
+		/* the planes point into a cache file */
+		munmap(world->mapping, world->mapsize);
+	}
+
+	quadtree_free(world->bounds);
+
+	struct world_state *st = world->state;
+	if (st) {
+		if (st->diagram.internal) {
+			jcv_diagram_free(&st->diagram);
+		}
+		cellmap_free(&st->cells);
+		free(st->site);
+		free(st->coast);
+		free(st->celltype);
+		/* the planes of a generated world live in the arena */
+		arena_destroy(st->arena);
+		free(st);
+	}
+
+	world->state = NULL;
+	world->bounds = NULL;
+	world->mapping = NULL;
+	world->height = NULL;
+	world->normal = NULL;
+	world->splat = NULL;
+	for (int i = 0; i < LAYER_COUNT; i++) {
+		world->layer[i] = NULL;
+	}
+}
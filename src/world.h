@@ -0,0 +1,110 @@
+/* world generation: builds the terrain heightmap on the CPU, no GL required */
+
+struct pool;
+struct quadtree;
+struct world_state;
+
+enum world_stage {
+	STAGE_NOISE,
+	STAGE_LAKES,
+	STAGE_ISLANDS,
+	STAGE_SITES,
+	STAGE_VORONOI,
+	STAGE_CELLS,
+	STAGE_COAST,
+	STAGE_MOUNTAINS,
+	STAGE_DISTANCE,
+	STAGE_RELIEF,
+	STAGE_EROSION,
+	STAGE_FLOW,
+	STAGE_RIVERS,
+	STAGE_COMPOSITE,
+	STAGE_BOUNDS,
+	STAGE_NORMALS,
+	STAGE_SPLAT,
+	STAGE_COUNT
+};
+
+/* bump whenever a change to the pipeline changes its output, cached worlds
+ * of older versions are then ignored */
+#define WORLD_VERSION 9
+
+#define LAYER_LAND_MAX 100
+
+/* intermediate 8-bit planes kept next to the final heights */
+enum world_layer {
+	LAYER_ELEVATION, /* fbm noise the land mask is cut from */
+	LAYER_LAND, /* land mask with a soft coastline, LAYER_LAND_MAX inland */
+	LAYER_MOUNTAIN, /* mountain ranges with soft edges */
+	LAYER_RIVER, /* river mask with soft banks, 0 is a river bed */
+	LAYER_COUNT
+};
+
+/* channels of the splat map, the weights of a pixel sum to 255 */
+enum splat_material {
+	SPLAT_GRASS,
+	SPLAT_GRAVEL,
+	SPLAT_SNOW,
+	SPLAT_STONE,
+	SPLAT_COUNT
+};
+
+/* every tunable of the pipeline, world_default_params() gives the defaults */
+struct world_params {
+	uint64_t seed; /* the same seed and parameters always give the same world */
+	int resolution; /* width and height of the heightmap in pixels */
+	float land_threshold; /* noise value above which a pixel is land */
+	int min_lake_size; /* smaller lakes are filled, in pixels */
+	int min_island_size; /* smaller islands are flooded, in pixels */
+	float coast_blur; /* width of the coastline falloff, as a gaussian sigma */
+	float site_spacing; /* minimum distance between voronoi sites in pixels */
+	float mountain_threshold; /* noise value at an inland cell center that raises a mountain */
+	float mountain_blur; /* width of the falloff around the mountain ranges */
+	int river_area; /* pixels that must drain through a pixel for a river to run there */
+	float river_width; /* of the widest rivers, in pixels */
+	float river_blur; /* width of the falloff of the river banks */
+	long erosion_droplets; /* droplets of hydraulic erosion, 0 turns it off */
+	int flow_dinf; /* split the flow between two neighbors with D-infinity instead of D8 */
+};
+
+struct world {
+	int resolution; /* width and height of the heightmap in pixels */
+	struct world_params params;
+	unsigned short *height; /* final 16-bit heights, row-major */
+	short *normal; /* x and z of the unit surface normal per pixel, as RG16_SNORM */
+	unsigned char *splat; /* RGBA8 material weights per pixel, see enum splat_material */
+	unsigned char *layer[LAYER_COUNT];
+	struct quadtree *bounds; /* min/max pyramid of the heights, see quadtree.h */
+	double stage_time[STAGE_COUNT]; /* wall time of each stage in milliseconds */
+	struct world_state *state; /* intermediates for world_update(), NULL for cached worlds */
+	void *mapping; /* set when the planes are mapped from a cache file */
+	size_t mapsize;
+};
+
+void world_default_params(struct world_params *params, uint64_t seed, int resolution);
+
+/* key of a world in the cache, covers the parameters and WORLD_VERSION */
+uint64_t world_params_hash(const struct world_params *params);
+
+/* the pool spreads the parallel stages over its threads, it may be NULL */
+void world_generate(struct world *world, const struct world_params *params, struct pool *pool);
+
+/* generates like world_generate() for a world that is kept as it is, the
+ * intermediate planes share memory once no later stage reads them, which
+ * lowers the peak, and a world_update() of it reruns every stage */
+void world_bake(struct world *world, const struct world_params *params, struct pool *pool);
+
+/* regenerates the world for new parameters, only the stages that read a
+ * changed parameter and the stages downstream of them run again, the others
+ * keep their buffers and report a stage time of 0 */
+void world_update(struct world *world, const struct world_params *params, struct pool *pool);
+
+void world_free(struct world *world);
+
+/* bytes of pixel planes and stage scratch a generation at this resolution
+ * holds, what world_bake() holds at its peak when aliased and
+ * world_generate() when not, the per-cell data of the voronoi stages and
+ * tables of a fixed size such as the 512 KB of flood buckets come on top */
+size_t world_plane_bytes(int resolution, int aliased);
+
+const char *world_stage_name(enum world_stage stage);
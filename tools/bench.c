@@ -0,0 +1,745 @@
+/* bench: repeatable microbenchmarks of the generation kernels, writes the
+ * median and spread of every benchmark as JSON */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "gmath.h"
+#include "bitmask.h"
+#include "heightfield.h"
+#include "edt.h"
+#include "erode.h"
+#include "hydro.h"
+#include "imp.h"
+#include "noise.h"
+#include "poisson.h"
+#include "pool.h"
+#include "rng.h"
+#include "trace.h"
+#include "voronoi.h"
+#include "world.h"
+
+#define NOISE_SAMPLES (1 << 20)
+#define CANVAS 1024
+#define NSHAPES 1000
+
+struct bench {
+	const char *filter; /* only run benchmarks whose name contains this */
+	int reps;
+	int quick; /* skip the largest sizes */
+	struct pool *pool;
+	FILE *out;
+	int nresults;
+};
+
+/* one benchmark: run() is timed, reset() restores its input between runs */
+struct kernel {
+	const char *name;
+	char params[128]; /* JSON object members describing the input */
+	void (*run)(void *ctx);
+	void (*reset)(void *ctx);
+	void *ctx;
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+	const double x = *(const double *)a;
+	const double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* one untimed warmup run, then reps timed runs */
+static void measure(struct bench *b, const struct kernel *k, int reps)
+{
+	if (b->filter && strstr(k->name, b->filter) == NULL) {
+		return;
+	}
+
+	fprintf(stderr, "%s {%s}\n", k->name, k->params);
+	double t[reps];
+	for (int i = -1; i < reps; i++) {
+		if (k->reset) {
+			k->reset(k->ctx);
+		}
+		double start = trace_now_ms();
+		k->run(k->ctx);
+		if (i >= 0) {
+			t[i] = trace_now_ms() - start;
+		}
+	}
+
+	double mean = 0.0;
+	for (int i = 0; i < reps; i++) {
+		mean += t[i];
+	}
+	mean /= reps;
+	double variance = 0.0;
+	for (int i = 0; i < reps; i++) {
+		variance += (t[i] - mean) * (t[i] - mean);
+	}
+	variance = reps > 1 ? variance / (reps - 1) : 0.0;
+
+	qsort(t, reps, sizeof(double), cmp_double);
+	const double median = (reps % 2) ? t[reps/2] : 0.5 * (t[reps/2-1] + t[reps/2]);
+
+	fprintf(b->out, "%s\n    {\"name\": \"%s\", \"params\": {%s}, \"reps\": %d, "
+		"\"median_ms\": %.4f, \"mean_ms\": %.4f, \"variance_ms2\": %.6f, \"min_ms\": %.4f, \"max_ms\": %.4f}",
+		b->nresults ? "," : "", k->name, k->params, reps,
+		median, mean, variance, t[0], t[reps-1]);
+	b->nresults++;
+}
+
+/* noise */
+
+struct noise_ctx {
+	float *x, *y, *out;
+};
+
+static void run_fbm_scalar(void *arg)
+{
+	struct noise_ctx *c = arg;
+	for (int i = 0; i < NOISE_SAMPLES; i++) {
+		c->out[i] = fbm_noise(c->x[i], c->y[i], 0.005, 2.5, 2.0, 0);
+	}
+}
+
+static void run_fbm_batch(void *arg)
+{
+	struct noise_ctx *c = arg;
+	fbm_noise_batch(c->out, c->x, c->y, NOISE_SAMPLES, 0.005, 2.5, 2.0, 0);
+}
+
+static void run_worley_scalar(void *arg)
+{
+	struct noise_ctx *c = arg;
+	for (int i = 0; i < NOISE_SAMPLES; i++) {
+		c->out[i] = worley_noise(c->x[i], c->y[i]);
+	}
+}
+
+static void run_worley_batch(void *arg)
+{
+	struct noise_ctx *c = arg;
+	worley_noise_batch(c->out, c->x, c->y, NOISE_SAMPLES);
+}
+
+static void bench_noise(struct bench *b)
+{
+	struct noise_ctx c;
+	c.x = malloc(3 * NOISE_SAMPLES * sizeof(float));
+	c.y = c.x + NOISE_SAMPLES;
+	c.out = c.y + NOISE_SAMPLES;
+	for (int i = 0; i < NOISE_SAMPLES; i++) {
+		c.x[i] = 0.5 * (i % CANVAS);
+		c.y[i] = 0.5 * (i / CANVAS);
+	}
+
+	struct kernel k = { .ctx = &c };
+	snprintf(k.params, sizeof(k.params), "\"samples\": %d, \"isa\": \"scalar\"", NOISE_SAMPLES);
+	k.name = "fbm_noise";
+	k.run = run_fbm_scalar;
+	measure(b, &k, b->reps);
+	k.name = "worley_noise";
+	k.run = run_worley_scalar;
+	measure(b, &k, b->reps);
+
+	const enum noise_isa best = noise_get_isa();
+	for (int isa = NOISE_SCALAR; isa <= best; isa++) {
+		noise_set_isa(isa);
+		snprintf(k.params, sizeof(k.params), "\"samples\": %d, \"isa\": \"%s\"", NOISE_SAMPLES, noise_isa_name(isa));
+		k.name = "fbm_noise_batch";
+		k.run = run_fbm_batch;
+		measure(b, &k, b->reps);
+		k.name = "worley_noise_batch";
+		k.run = run_worley_batch;
+		measure(b, &k, b->reps);
+	}
+	noise_set_isa(best);
+
+	free(c.x);
+}
+
+/* region removal on a thresholded fbm mask, the input of the lake stage */
+
+struct mask_ctx {
+	unsigned char *mask;
+	unsigned char *work;
+	int *labels;
+	int seedx, seedy;
+	vec2 *points;
+	float spacing;
+	int npoints;
+	float *dist;
+	struct bitmask bits;
+	struct bitmask edge;
+	struct pool *pool;
+};
+
+static void reset_mask(void *arg)
+{
+	struct mask_ctx *c = arg;
+	memcpy(c->work, c->mask, CANVAS * CANVAS);
+}
+
+static void run_floodfill(void *arg)
+{
+	struct mask_ctx *c = arg;
+	struct image work = image_wrap(c->work, CANVAS, CANVAS, 1, IMAGE_U8);
+	floodfill(c->seedx, c->seedy, &work, c->work[c->seedy * CANVAS + c->seedx], 255);
+}
+
+static void run_label(void *arg)
+{
+	struct mask_ctx *c = arg;
+	struct component *comp;
+	const struct image work = image_wrap(c->work, CANVAS, CANVAS, 1, IMAGE_U8);
+	label_components(&work, c->labels, &comp);
+	free(comp);
+}
+
+/* packs the mask and drops the lakes below the default size of a 1024 world */
+static void run_bitmask_components(void *arg)
+{
+	struct mask_ctx *c = arg;
+	bitmask_pack(&c->bits, c->work, 0);
+	bitmask_clear_components(&c->bits, 2, 256);
+}
+
+static void run_bitmask_boundary(void *arg)
+{
+	struct mask_ctx *c = arg;
+	bitmask_boundary(&c->edge, &c->bits);
+}
+
+static void run_poisson(void *arg)
+{
+	struct mask_ctx *c = arg;
+	struct rng rng = rng_seed(3);
+	c->npoints = poisson_disc(c->points, c->mask, CANVAS, CANVAS, 100, c->spacing, &rng);
+}
+
+static void run_edt(void *arg)
+{
+	struct mask_ctx *c = arg;
+	edt_signed(c->dist, c->dist + CANVAS * CANVAS, c->mask, 100, CANVAS, CANVAS, c->pool);
+}
+
+static void bench_mask(struct bench *b)
+{
+	struct mask_ctx c;
+	c.mask = malloc(2 * CANVAS * CANVAS);
+	c.work = c.mask + CANVAS * CANVAS;
+	c.labels = malloc(CANVAS * CANVAS * sizeof(int));
+
+	float *field = malloc(CANVAS * CANVAS * sizeof(float));
+	fbm_field(field, CANVAS, CANVAS, 1.0, 0.005, 2.5, 2.0, 0, b->pool);
+	for (int i = 0; i < CANVAS * CANVAS; i++) {
+		c.mask[i] = field[i] > 0.55 ? 100 : 0;
+	}
+	free(field);
+
+	/* fill the biggest component, the worst case of the old lake removal */
+	struct component *comp;
+	const struct image mask = image_wrap(c.mask, CANVAS, CANVAS, 1, IMAGE_U8);
+	int n = label_components(&mask, c.labels, &comp);
+	int big = 0;
+	for (int i = 1; i < n; i++) {
+		if (comp[i].size > comp[big].size) {
+			big = i;
+		}
+	}
+	for (int i = 0; i < CANVAS * CANVAS; i++) {
+		if (c.labels[i] == big) {
+			c.seedx = i % CANVAS;
+			c.seedy = i / CANVAS;
+			break;
+		}
+	}
+
+	struct kernel k = { .reset = reset_mask, .ctx = &c };
+	snprintf(k.params, sizeof(k.params), "\"size\": %d, \"pixels\": %d", CANVAS, comp[big].size);
+	k.name = "floodfill";
+	k.run = run_floodfill;
+	measure(b, &k, b->reps);
+
+	snprintf(k.params, sizeof(k.params), "\"size\": %d, \"components\": %d", CANVAS, n);
+	k.name = "label_components";
+	k.run = run_label;
+	measure(b, &k, b->reps);
+
+	c.bits = bitmask_make(CANVAS, CANVAS);
+	c.edge = bitmask_make(CANVAS, CANVAS);
+	snprintf(k.params, sizeof(k.params), "\"size\": %d", CANVAS);
+	k.name = "bitmask_components";
+	k.run = run_bitmask_components;
+	measure(b, &k, b->reps);
+
+	k.name = "bitmask_boundary";
+	k.run = run_bitmask_boundary;
+	measure(b, &k, b->reps);
+	bitmask_free(&c.edge);
+	bitmask_free(&c.bits);
+
+	/* site sampling on the land, from the default spacing to 100k+ sites */
+	const float spacings[] = {25.6, 8.0, 2.0, 1.5};
+	k.name = "poisson_disc";
+	k.run = run_poisson;
+	k.reset = NULL;
+	for (int i = 0; i < 4; i++) {
+		c.spacing = spacings[i];
+		c.points = malloc(poisson_capacity(CANVAS, CANVAS, c.spacing) * sizeof(vec2));
+		run_poisson(&c);
+		snprintf(k.params, sizeof(k.params), "\"size\": %d, \"spacing\": %.1f, \"sites\": %d", CANVAS, c.spacing, c.npoints);
+		measure(b, &k, b->reps);
+		free(c.points);
+	}
+
+	/* signed distance to the coast, what replaced the land blur */
+	c.dist = malloc(2 * CANVAS * CANVAS * sizeof(float));
+	c.pool = b->pool;
+	snprintf(k.params, sizeof(k.params), "\"size\": %d, \"threads\": %d", CANVAS, pool_size(b->pool));
+	k.name = "edt_signed";
+	k.run = run_edt;
+	measure(b, &k, b->reps);
+	free(c.dist);
+
+	free(comp);
+	free(c.labels);
+	free(c.mask);
+}
+
+/* hydrology on an fbm relief */
+
+struct hydro_ctx {
+	unsigned short *height;
+	float *heightf;
+	unsigned short *filled;
+	float *filledf;
+	unsigned char *dir;
+	int *order;
+	int *next;
+	float *frac;
+	float *accum;
+	float *eroded;
+	long droplets;
+	struct pool *pool;
+};
+
+static void run_flood_u16(void *arg)
+{
+	struct hydro_ctx *c = arg;
+	hydro_flood_u16(c->height, NULL, CANVAS, CANVAS, c->filled, c->dir, c->order, c->next);
+}
+
+static void run_flood_float(void *arg)
+{
+	struct hydro_ctx *c = arg;
+	hydro_flood_float(c->heightf, NULL, CANVAS, CANVAS, c->filledf, c->dir, c->order);
+}
+
+static void run_accumulate(void *arg)
+{
+	struct hydro_ctx *c = arg;
+	hydro_accumulate(c->dir, c->order, CANVAS, CANVAS, c->accum);
+}
+
+static void run_dinf(void *arg)
+{
+	struct hydro_ctx *c = arg;
+	hydro_dinf_u16(c->filled, CANVAS, CANVAS, c->dir, c->frac);
+}
+
+static void run_accumulate_dinf(void *arg)
+{
+	struct hydro_ctx *c = arg;
+	hydro_accumulate_dinf(c->dir, c->frac, c->order, CANVAS, CANVAS, c->accum);
+}
+
+static void reset_erode(void *arg)
+{
+	struct hydro_ctx *c = arg;
+	for (int i = 0; i < CANVAS * CANVAS; i++) {
+		c->eroded[i] = c->heightf[i] * (CANVAS / 16.f);
+	}
+}
+
+static void run_erode(void *arg)
+{
+	struct hydro_ctx *c = arg;
+	struct rng rng = rng_seed(5);
+	erode_droplets(c->eroded, CANVAS, CANVAS, c->droplets, &rng, c->pool);
+}
+
+static void bench_hydro(struct bench *b)
+{
+	const int size = CANVAS * CANVAS;
+	struct hydro_ctx c;
+	c.heightf = malloc(size * sizeof(float));
+	c.filledf = malloc(size * sizeof(float));
+	c.accum = malloc(size * sizeof(float));
+	c.height = malloc(size * sizeof(unsigned short));
+	c.filled = malloc(size * sizeof(unsigned short));
+	c.dir = malloc(size);
+	c.order = malloc(size * sizeof(int));
+	c.next = malloc(size * sizeof(int));
+	c.frac = malloc(size * sizeof(float));
+
+	fbm_field(c.heightf, CANVAS, CANVAS, 1.0, 0.005, 2.5, 2.0, 0, b->pool);
+	for (int i = 0; i < size; i++) {
+		c.height[i] = c.heightf[i] * 65535.f;
+	}
+
+	struct kernel k = { .ctx = &c };
+	snprintf(k.params, sizeof(k.params), "\"size\": %d", CANVAS);
+	k.name = "hydro_flood_u16";
+	k.run = run_flood_u16;
+	measure(b, &k, b->reps);
+	k.name = "hydro_accumulate";
+	k.run = run_accumulate;
+	measure(b, &k, b->reps);
+	k.name = "hydro_dinf_u16";
+	k.run = run_dinf;
+	measure(b, &k, b->reps);
+	k.name = "hydro_accumulate_dinf";
+	k.run = run_accumulate_dinf;
+	measure(b, &k, b->reps);
+	k.name = "hydro_flood_float";
+	k.run = run_flood_float;
+	measure(b, &k, b->reps);
+
+	/* heights in pixels like the erosion stage, droplets/s is droplets over the median */
+	c.eroded = malloc(size * sizeof(float));
+	c.pool = b->pool;
+	const long droplets[] = {CANVAS * CANVAS / 8, CANVAS * CANVAS};
+	k.name = "erode_droplets";
+	k.run = run_erode;
+	k.reset = reset_erode;
+	for (int i = 0; i < (b->quick ? 1 : 2); i++) {
+		c.droplets = droplets[i];
+		snprintf(k.params, sizeof(k.params), "\"size\": %d, \"droplets\": %ld, \"threads\": %d", CANVAS, c.droplets, pool_size(b->pool));
+		measure(b, &k, b->reps);
+	}
+	free(c.eroded);
+
+	free(c.frac);
+	free(c.next);
+	free(c.order);
+	free(c.dir);
+	free(c.filled);
+	free(c.height);
+	free(c.accum);
+	free(c.filledf);
+	free(c.heightf);
+}
+
+/* ground queries, a frame's worth of random positions on the fbm relief */
+
+#define QUERIES 65536
+
+struct query_ctx {
+	struct heightfield field;
+	float *x;
+	float *z;
+	float *height;
+	vec3 *normal; /* NULL times heights only */
+};
+
+static void run_query(void *arg)
+{
+	struct query_ctx *c = arg;
+	heightfield_sample(&c->field, c->x, c->z, QUERIES, c->height, c->normal);
+}
+
+static void bench_query(struct bench *b)
+{
+	struct query_ctx c;
+	unsigned short *heights = malloc(CANVAS * CANVAS * sizeof(unsigned short));
+	float *field = malloc(CANVAS * CANVAS * sizeof(float));
+	fbm_field(field, CANVAS, CANVAS, 1.0, 0.005, 2.5, 2.0, 0, b->pool);
+	for (int i = 0; i < CANVAS * CANVAS; i++) {
+		heights[i] = field[i] * 65535.f;
+	}
+	free(field);
+	c.field = (struct heightfield){heights, CANVAS, CANVAS, TERRAIN_EXTENT, TERRAIN_SCALE, TERRAIN_OFFSET};
+
+	c.x = malloc(QUERIES * sizeof(float));
+	c.z = malloc(QUERIES * sizeof(float));
+	c.height = malloc(QUERIES * sizeof(float));
+	vec3 *normal = malloc(QUERIES * sizeof(vec3));
+	struct rng rng = rng_seed(4);
+	for (int i = 0; i < QUERIES; i++) {
+		c.x[i] = rng_float(&rng) * TERRAIN_EXTENT;
+		c.z[i] = rng_float(&rng) * TERRAIN_EXTENT;
+	}
+
+	struct kernel k = { .name = "heightfield_sample", .run = run_query, .ctx = &c };
+	for (int i = 0; i < 2; i++) {
+		c.normal = i ? normal : NULL;
+		snprintf(k.params, sizeof(k.params), "\"size\": %d, \"queries\": %d, \"normals\": %d", CANVAS, QUERIES, i);
+		measure(b, &k, b->reps);
+	}
+
+	free(normal);
+	free(c.height);
+	free(c.z);
+	free(c.x);
+	free(heights);
+}
+
+/* rasterizers */
+
+struct raster_ctx {
+	struct image canvas;
+	float *shape; /* NSHAPES * 6 coordinates */
+	float width;
+};
+
+static void reset_canvas(void *arg)
+{
+	struct raster_ctx *c = arg;
+	memset(c->canvas.data, 0, c->canvas.stride * CANVAS);
+}
+
+static void run_triangles(void *arg)
+{
+	struct raster_ctx *c = arg;
+	unsigned char color = 255;
+	for (int i = 0; i < NSHAPES; i++) {
+		const float *s = &c->shape[6*i];
+		draw_triangle(s[0], s[1], s[2], s[3], s[4], s[5], &c->canvas, &color);
+	}
+}
+
+static void run_thick_lines(void *arg)
+{
+	struct raster_ctx *c = arg;
+	unsigned char color = 255;
+	for (int i = 0; i < NSHAPES; i++) {
+		const float *s = &c->shape[6*i];
+		draw_thick_line(s[0], s[1], s[2], s[3], &c->canvas, &color, c->width);
+	}
+}
+
+static void bench_raster(struct bench *b)
+{
+	struct raster_ctx c;
+	c.canvas = image_make(CANVAS, CANVAS, 1, IMAGE_U8);
+	c.shape = malloc(NSHAPES * 6 * sizeof(float));
+
+	/* voronoi cell sized triangles and river sized segments */
+	struct rng rng = rng_seed(1);
+	for (int i = 0; i < NSHAPES; i++) {
+		float *s = &c.shape[6*i];
+		s[0] = 64 + rng_float(&rng) * (CANVAS - 128);
+		s[1] = 64 + rng_float(&rng) * (CANVAS - 128);
+		for (int j = 2; j < 6; j++) {
+			s[j] = s[j%2] + (rng_float(&rng) - 0.5f) * 128;
+		}
+	}
+
+	struct kernel k = { .reset = reset_canvas, .ctx = &c };
+	snprintf(k.params, sizeof(k.params), "\"size\": %d, \"triangles\": %d", CANVAS, NSHAPES);
+	k.name = "draw_triangle";
+	k.run = run_triangles;
+	measure(b, &k, b->reps);
+
+	const float widths[] = {1.0, 8.0, 32.0};
+	for (int i = 0; i < 3; i++) {
+		c.width = widths[i];
+		snprintf(k.params, sizeof(k.params), "\"size\": %d, \"lines\": %d, \"width\": %.0f", CANVAS, NSHAPES, c.width);
+		k.name = "draw_thick_line";
+		k.run = run_thick_lines;
+		measure(b, &k, b->reps);
+	}
+
+	free(c.shape);
+	image_free(&c.canvas);
+}
+
+/* gaussian blur */
+
+struct blur_ctx {
+	unsigned char *image;
+	int channels;
+	enum image_format format;
+	float sigma;
+};
+
+static void reset_blur(void *arg)
+{
+	struct blur_ctx *c = arg;
+	float *f = (float *)c->image;
+	for (size_t i = 0; i < (size_t)CANVAS * CANVAS * c->channels; i++) {
+		const unsigned char v = (i * 2654435761u) >> 24;
+		if (c->format == IMAGE_F32) {
+			f[i] = v / 255.f;
+		} else {
+			c->image[i] = v;
+		}
+	}
+}
+
+static void run_blur(void *arg)
+{
+	struct blur_ctx *c = arg;
+	struct image image = image_wrap(c->image, CANVAS, CANVAS, c->channels, c->format);
+	image_gauss_blur(&image, c->sigma);
+}
+
+static void bench_blur(struct bench *b)
+{
+	struct blur_ctx c;
+	c.image = malloc(CANVAS * CANVAS * 4);
+
+	const float sigmas[] = {1.0, 5.0, 10.0, 20.0};
+	const int channels[] = {1, 3, 4};
+	struct kernel k = { .name = "image_gauss_blur", .run = run_blur, .reset = reset_blur, .ctx = &c };
+	c.format = IMAGE_U8;
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 4; j++) {
+			c.channels = channels[i];
+			c.sigma = sigmas[j];
+			snprintf(k.params, sizeof(k.params), "\"size\": %d, \"channels\": %d, \"format\": \"u8\", \"sigma\": %.1f", CANVAS, c.channels, c.sigma);
+			measure(b, &k, b->reps);
+		}
+	}
+	/* one channel of floats fits the same buffer */
+	c.format = IMAGE_F32;
+	c.channels = 1;
+	for (int j = 0; j < 4; j++) {
+		c.sigma = sigmas[j];
+		snprintf(k.params, sizeof(k.params), "\"size\": %d, \"channels\": %d, \"format\": \"f32\", \"sigma\": %.1f", CANVAS, c.channels, c.sigma);
+		measure(b, &k, b->reps);
+	}
+
+	free(c.image);
+}
+
+/* voronoi diagram */
+
+struct voronoi_ctx {
+	jcv_point *site;
+	int nsite;
+};
+
+static void run_voronoi(void *arg)
+{
+	struct voronoi_ctx *c = arg;
+	jcv_diagram diagram;
+	memset(&diagram, 0, sizeof(jcv_diagram));
+	jcv_diagram_generate(c->nsite, c->site, 0, 0, &diagram);
+	jcv_diagram_free(&diagram);
+}
+
+static void bench_voronoi(struct bench *b)
+{
+	const int counts[] = {500, 5000, 50000, 1000000};
+	const int ncounts = b->quick ? 3 : 4;
+
+	struct voronoi_ctx c;
+	c.site = malloc(counts[ncounts-1] * sizeof(jcv_point));
+	struct rng rng = rng_seed(2);
+	for (int i = 0; i < counts[ncounts-1]; i++) {
+		c.site[i].x = rng_float(&rng) * CANVAS;
+		c.site[i].y = rng_float(&rng) * CANVAS;
+	}
+
+	struct kernel k = { .name = "jcv_diagram_generate", .run = run_voronoi, .ctx = &c };
+	for (int i = 0; i < ncounts; i++) {
+		c.nsite = counts[i];
+		snprintf(k.params, sizeof(k.params), "\"sites\": %d", c.nsite);
+		measure(b, &k, c.nsite >= 1000000 ? min(b->reps, 3) : b->reps);
+	}
+
+	free(c.site);
+}
+
+/* the whole pipeline */
+
+struct world_ctx {
+	struct world_params params;
+	struct pool *pool;
+};
+
+static void run_world(void *arg)
+{
+	struct world_ctx *c = arg;
+	struct world world;
+	world_generate(&world, &c->params, c->pool);
+	world_free(&world);
+}
+
+static void bench_world(struct bench *b)
+{
+	const int sizes[] = {1024, 2048, 4096, 8192};
+	const int nsizes = b->quick ? 2 : 4;
+
+	struct world_ctx c = { .pool = b->pool };
+	struct kernel k = { .name = "world_generate", .run = run_world, .ctx = &c };
+	for (int i = 0; i < nsizes; i++) {
+		world_default_params(&c.params, 42, sizes[i]);
+		snprintf(k.params, sizeof(k.params), "\"resolution\": %d, \"threads\": %d", sizes[i], pool_size(b->pool));
+		measure(b, &k, sizes[i] >= 4096 ? min(b->reps, 3) : b->reps);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-r reps] [-f filter] [-j threads] [-q] [-o output.json]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench b = { .reps = 10, .out = stdout };
+	int nthreads = 0;
+	const char *output = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "r:f:j:qo:h")) != -1) {
+		switch (opt) {
+		case 'r': b.reps = atoi(optarg); break;
+		case 'f': b.filter = optarg; break;
+		case 'j': nthreads = atoi(optarg); break;
+		case 'q': b.quick = 1; break;
+		case 'o': output = optarg; break;
+		default: usage(argv[0]); exit(EXIT_FAILURE);
+		}
+	}
+
+	if (b.reps < 1) {
+		fprintf(stderr, "error: need at least one repetition\n");
+		exit(EXIT_FAILURE);
+	}
+	if (output) {
+		b.out = fopen(output, "w");
+		if (b.out == NULL) {
+			perror(output);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	b.pool = pool_create(nthreads);
+
+	fprintf(b.out, "{\n  \"isa\": \"%s\",\n  \"threads\": %d,\n  \"results\": [",
+		noise_isa_name(noise_get_isa()), pool_size(b.pool));
+	bench_noise(&b);
+	bench_mask(&b);
+	bench_hydro(&b);
+	bench_query(&b);
+	bench_raster(&b);
+	bench_blur(&b);
+	bench_voronoi(&b);
+	bench_world(&b);
+	fprintf(b.out, "\n  ]\n}\n");
+
+	pool_destroy(b.pool);
+	if (output && fclose(b.out) != 0) {
+		perror(output);
+		exit(EXIT_FAILURE);
+	}
+
+	exit(EXIT_SUCCESS);
+}
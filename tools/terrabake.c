@@ -0,0 +1,207 @@
+/* terrabake: generates a world heightmap without a window or GL context
+ * and writes it as a 16-bit PGM or raw file */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "pool.h"
+#include "tiled.h"
+#include "world.h"
+#include "cache.h"
+#include "trace.h"
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-r resolution] [-s seed] [-j threads] [-e droplets] [-d] [-T tiled resolution] [-c cachedir] [-n] [-t trace.json] [-o output.pgm|output.raw]\n", prog);
+}
+
+static int has_suffix(const char *s, const char *suffix)
+{
+	size_t n = strlen(s);
+	size_t m = strlen(suffix);
+
+	return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+/* PGM stores 16-bit samples big-endian, raw files keep the host order */
+struct heightmap_file {
+	FILE *fp;
+	const char *path;
+	int res;
+	int pgm;
+	unsigned char *row; /* one big-endian row of a PGM */
+};
+
+static int open_heightmap(struct heightmap_file *file, const char *fpath, int res)
+{
+	file->path = fpath;
+	file->res = res;
+	file->pgm = !has_suffix(fpath, ".raw");
+	file->row = NULL;
+	file->fp = fopen(fpath, "wb");
+	if (file->fp == NULL) {
+		perror(fpath);
+		return 0;
+	}
+
+	if (file->pgm) {
+		/* on the heap, rows of tiled heightmaps outgrow the stack */
+		file->row = malloc(2 * (size_t)res);
+		fprintf(file->fp, "P5\n%d %d\n65535\n", res, res);
+	}
+
+	return 1;
+}
+
+/* a tiled_writer, the rows arrive in order */
+static int write_rows(void *ctx, const unsigned short *rows, int y, int nrows)
+{
+	struct heightmap_file *file = ctx;
+	const int res = file->res;
+
+	if (!file->pgm) {
+		const size_t size = (size_t)res * nrows;
+		return fwrite(rows, sizeof(unsigned short), size, file->fp) == size;
+	}
+
+	unsigned char *row = file->row;
+	for (int i = 0; i < nrows; i++) {
+		const unsigned short *src = &rows[(size_t)i * res];
+		for (int x = 0; x < res; x++) {
+			row[2*x] = src[x] >> 8;
+			row[2*x+1] = src[x] & 0xff;
+		}
+		if (fwrite(row, 2, res, file->fp) != (size_t)res) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int close_heightmap(struct heightmap_file *file, int ok)
+{
+	free(file->row);
+	if (fclose(file->fp) != 0) {
+		ok = 0;
+	}
+	if (!ok) {
+		fprintf(stderr, "error: %s: could not write heightmap\n", file->path);
+	}
+
+	return ok;
+}
+
+static int write_heightmap(const char *fpath, const unsigned short *height, int res)
+{
+	struct heightmap_file file;
+	if (!open_heightmap(&file, fpath, res)) {
+		return 0;
+	}
+
+	return close_heightmap(&file, write_rows(&file, height, 0, res));
+}
+
+/* the world is the overview of a tiled heightmap of size tiled */
+static int bake_tiled(const struct world *world, int tiled, int nthreads, const char *output)
+{
+	struct heightmap_file file;
+	if (!open_heightmap(&file, output, tiled)) {
+		return 0;
+	}
+
+	struct pool *pool = pool_create(nthreads);
+	struct tiled_stats stats;
+	int ok = tiled_bake(world, tiled, TILED_TILE, write_rows, &file, pool, &stats);
+	pool_destroy(pool);
+	ok = close_heightmap(&file, ok);
+
+	printf("%-10s %10.2f ms\n", "tiles", stats.tiles_ms);
+	printf("%-10s %10.2f ms\n", "write", stats.write_ms);
+	printf("%-10s %10.2f Mpixel/s\n", "tiled", (double)tiled * tiled / stats.tiles_ms / 1000.0);
+	printf("%-10s %10.2f MB\n", "band", stats.band_bytes / 1048576.0);
+
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t seed = 0;
+	int res = 2048;
+	int nthreads = 0;
+	int tiled = 0;
+	long droplets = -1;
+	int dinf = 0;
+	const char *output = "heightmap.pgm";
+	const char *cachedir = cache_default_dir();
+
+	int opt;
+	while ((opt = getopt(argc, argv, "r:s:j:e:dT:c:nt:o:h")) != -1) {
+		switch (opt) {
+		case 'r': res = atoi(optarg); break;
+		case 's': seed = strtoull(optarg, NULL, 0); break;
+		case 'j': nthreads = atoi(optarg); break;
+		case 'e': droplets = atol(optarg); break;
+		case 'd': dinf = 1; break;
+		case 'T': tiled = atoi(optarg); break;
+		case 'c': cachedir = optarg; break;
+		case 'n': cachedir = NULL; break;
+		case 't': trace_start(optarg); break;
+		case 'o': output = optarg; break;
+		default: usage(argv[0]); exit(EXIT_FAILURE);
+		}
+	}
+
+	if (res < 64) {
+		fprintf(stderr, "error: resolution must be at least 64\n");
+		exit(EXIT_FAILURE);
+	}
+
+	struct world_params params;
+	world_default_params(&params, seed, res);
+	if (droplets >= 0) {
+		params.erosion_droplets = droplets;
+	}
+	params.flow_dinf = dinf;
+
+	if (tiled && tiled < res) {
+		fprintf(stderr, "error: the tiled resolution must be at least the overview resolution\n");
+		exit(EXIT_FAILURE);
+	}
+
+	struct world world;
+	const int hit = cachedir && cache_load(cachedir, &params, &world);
+	if (hit) {
+		printf("cache hit %016llx\n", (unsigned long long)world_params_hash(&params));
+	} else {
+		struct pool *pool = pool_create(nthreads);
+		world_bake(&world, &params, pool);
+		pool_destroy(pool);
+		if (cachedir) {
+			cache_store(cachedir, &world);
+		}
+	}
+
+	if (!hit) {
+		double total = 0.0;
+		for (int i = 0; i < STAGE_COUNT; i++) {
+			printf("%-10s %10.2f ms\n", world_stage_name(i), world.stage_time[i]);
+			total += world.stage_time[i];
+		}
+		printf("%-10s %10.2f ms\n", "total", total);
+		printf("%-10s %10.2f MB\n", "planes", world_plane_bytes(res, 1) / 1048576.0);
+		if (params.erosion_droplets > 0 && world.stage_time[STAGE_EROSION] > 0.0) {
+			printf("%-10s %10.2f M/s\n", "droplets", params.erosion_droplets / world.stage_time[STAGE_EROSION] / 1000.0);
+		}
+	}
+
+	/* a tiled bake refines the cached or generated world as its overview */
+	int ok = tiled ? bake_tiled(&world, tiled, nthreads, output) : write_heightmap(output, world.height, res);
+	world_free(&world);
+	if (!trace_stop()) {
+		ok = 0;
+	}
+
+	exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}